@@ -33,12 +33,24 @@
  
  */
 
+#include <map>
+#include <list>
 #include <cmath>
 #include <array>
+#include <mutex>
+#include <complex>
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <unordered_map>
+#include "parallel.h"
+#include "profile.h"
 using namespace std;
 #define LOG(x) std::cout << x << std::endl;
 
@@ -85,6 +97,7 @@ void ask(string question, string &answer){
 // polynomial operations
 vector<float> polyMult(vector<float> poly1, vector<float> poly2){
     // multiplies two polynomials
+    PROFILE_SCOPE("polyMult", 2 * poly1.size() * poly2.size(), 4 * (poly1.size() + poly2.size() - 1));
     vector<float> newPoly (poly1.size() + poly2.size() - 1, 0);
     int x1, x2;
     for(x1 = 0; x1 < poly1.size(); x1++){
@@ -101,6 +114,7 @@ vector<float> polyMult(vector<float> poly1, vector<float> poly2){
 };
 vector<float> polyAdd(vector<float> poly1, vector<float> poly2){
     // adds two polynomials
+    PROFILE_SCOPE("polyAdd", max(poly1.size(), poly2.size()), 4 * max(poly1.size(), poly2.size()));
     vector<float> newPoly(max(poly1.size(), poly2.size()), 0);
     for(int i = 0; i < max(poly1.size(), poly2.size()); i++){
         if(!poly1[i] && poly2[i]){
@@ -117,6 +131,7 @@ vector<float> polyAdd(vector<float> poly1, vector<float> poly2){
 }
 vector<float> polySub(vector<float> poly1, vector<float> poly2){
     // subtracts two polynomials
+    PROFILE_SCOPE("polySub", max(poly1.size(), poly2.size()), 4 * max(poly1.size(), poly2.size()));
     vector<float> newPoly (max(poly1.size(), poly2.size()), 0);
     for(int i = 0; i < max(poly1.size(), poly2.size()); i++){
         if(!poly1[i] && poly2[i]){
@@ -133,6 +148,7 @@ vector<float> polySub(vector<float> poly1, vector<float> poly2){
 }
 vector<float> polyPow(vector<float> poly, int power){
     // raises polynomial to a positive power
+    PROFILE_SCOPE("polyPow", 0, 0);
     vector<float> newPoly(poly);
     for(int i = 0; i < power - 1; i++){
         newPoly = polyMult(newPoly, poly);
@@ -141,6 +157,7 @@ vector<float> polyPow(vector<float> poly, int power){
 }
 vector<float> polyInteg(vector <float> poly){
     // integrates polynomial with reverse power rule
+    PROFILE_SCOPE("polyInteg", poly.size(), 4 * (poly.size() + 1));
     vector<float> newPoly (poly.size() + 1, 0);
     for(int i = 0; i < poly.size(); i++){
         newPoly[i + 1] = poly[i] / (i + 1);
@@ -149,6 +166,7 @@ vector<float> polyInteg(vector <float> poly){
 }
 vector<float> polyDeriv(vector<float> poly){
     // derives polynomials with power rule
+    PROFILE_SCOPE("polyDeriv", poly.size(), 4 * poly.size());
     vector<float> newPoly (poly.size() - 1);
     for(int i = 1; i < poly.size(); i++){
         newPoly[i - 1] = poly[i] * i;
@@ -157,6 +175,7 @@ vector<float> polyDeriv(vector<float> poly){
 }
 float polyAt(vector<float> poly, float x){
     // returns the value of y at x
+    PROFILE_SCOPE("polyAt", 2 * poly.size(), 0);
     float value = 0;
     for(int i = 0; i < poly.size(); i++){
         value += poly[i] * pow(x, i);
@@ -164,10 +183,15 @@ float polyAt(vector<float> poly, float x){
     return value;
 }
 vector<float> polyLine(vector<float> poly, float x){
-    // calculates line tangent to curve at x
-    vector<float> deriv = polyDeriv(poly);
-    float m = polyAt(deriv, x),
-          y = polyAt(poly, x);
+    // calculates line tangent to curve at x, with the value and the
+    // slope carried through one Horner pass
+    PROFILE_SCOPE("polyLine", 4 * poly.size(), 0);
+    float m = 0,
+          y = 0;
+    for(int i = static_cast<int>(poly.size()) - 1; i >= 0; i--){
+        m = m * x + y;
+        y = y * x + poly[i];
+    }
     if(m){
         return vector<float> {y - m * x, m};
     }
@@ -177,6 +201,7 @@ vector<float> polyLine(vector<float> poly, float x){
 }
 vector<float> polyParse(string text){
     // The most complex function here, I won't bother to explain.
+    PROFILE_SCOPE("polyParse", 0, 0);
     if(text.length() == 0){
         return vector<float> {0.0};
     }
@@ -274,17 +299,19 @@ vector<float> polyParse(string text){
     return poly;
 };
 float polyEval(vector<float> poly, float a, float b){
-    // indefinite integral
-    float fin = 0;
+    // indefinite integral, taken at both ends by Horner's rule
+    PROFILE_SCOPE("polyEval", 0, 0);
+    float atA = 0, atB = 0;
     vector<float> integ = polyInteg(poly);
-    for(int i = 0; i < integ.size(); i++){
-        fin += integ[i] * pow(b, i);
-        fin -= integ[i] * pow(a, i);
+    for(int i = static_cast<int>(integ.size()) - 1; i >= 0; i--){
+        atA = atA * a + integ[i];
+        atB = atB * b + integ[i];
     }
-    return fin;
+    return atB - atA;
 }
 string polyReverse(vector<float> poly){
     // also not gonna explain
+    PROFILE_SCOPE("polyReverse", 0, 0);
     if(poly.size() == 1 && poly[0] == 0){
         return "0";
     }
@@ -328,6 +355,1479 @@ string polyReverse(vector<float> poly){
     return str;
 }
 
+// modular polynomial operations
+// Polynomials over Z/pZ with coefficients stored as uint32_t in [0, p).
+// Products go through a number theoretic transform: directly when p is
+// one of the NTT friendly primes below, otherwise as three transforms
+// over those primes put back together with the chinese remainder
+// theorem, which is also how exact integer products are done. Small
+// products are done term by term with Barrett reduction instead.
+
+// NTT friendly primes, c * 2^k + 1, with a primitive root of each
+const uint32_t nttPrimes[3] = {998244353, 167772161, 469762049};
+const uint32_t nttRoots[3] = {3, 3, 3};
+
+// longest transform all three primes support, 2^23 dividing each p - 1;
+// longer products are split before they get to a transform
+const size_t nttLimit = 1 << 23;
+
+// base ^ e mod p
+uint32_t powMod(uint64_t base, uint64_t e, uint32_t p){
+    uint64_t r = 1 % p;
+    base %= p;
+    for(; e; e >>= 1){
+        if(e & 1){
+            r = r * base % p;
+        }
+        base = base * base % p;
+    }
+    return static_cast<uint32_t>(r);
+}
+
+// Montgomery multiplication modulo an odd p < 2^30
+struct montgomery {
+    uint32_t p, pinv, r2;
+    montgomery(uint32_t mod){
+        p = mod;
+        uint32_t inv = p;
+        for(int i = 0; i < 4; i++){
+            inv *= 2 - p * inv;
+        }
+        pinv = -inv;
+        r2 = static_cast<uint32_t>((static_cast<unsigned __int128>(1) << 64) % p);
+    }
+    uint32_t reduce(uint64_t x) const {
+        uint32_t m = static_cast<uint32_t>(x) * pinv;
+        uint32_t t = static_cast<uint32_t>((x + static_cast<uint64_t>(m) * p) >> 32);
+        return t >= p ? t - p : t;
+    }
+    uint32_t mul(uint32_t a, uint32_t b) const {
+        return reduce(static_cast<uint64_t>(a) * b);
+    }
+    uint32_t to(uint32_t a) const {
+        return mul(a, r2);
+    }
+    uint32_t from(uint32_t a) const {
+        return reduce(a);
+    }
+};
+
+// Barrett reduction of products modulo any p < 2^32
+struct barrett {
+    uint64_t p, m;
+    barrett(uint32_t mod){
+        p = mod;
+        m = static_cast<uint64_t>(-1) / p;
+    }
+    uint32_t reduce(uint64_t x) const {
+        uint64_t q = static_cast<uint64_t>((static_cast<unsigned __int128>(x) * m) >> 64);
+        uint64_t r = x - q * p;
+        return static_cast<uint32_t>(r >= p ? r - p : r);
+    }
+};
+
+// in place transform of a power of two length modulo prime k of
+// nttPrimes, values in Montgomery form
+void ntt(vector<uint32_t> &a, bool invert, int k){
+    const montgomery mg(nttPrimes[k]);
+    uint32_t p = mg.p;
+    int n = static_cast<int>(a.size());
+    for(int i = 1, j = 0; i < n; i++){
+        int bit = n >> 1;
+        for(; j & bit; bit >>= 1){
+            j ^= bit;
+        }
+        j ^= bit;
+        if(i < j){
+            swap(a[i], a[j]);
+        }
+    }
+    vector<uint32_t> w(n / 2 + 1);
+    for(int len = 2; len <= n; len <<= 1){
+        uint32_t root = powMod(nttRoots[k], (p - 1) / len, p);
+        if(invert){
+            root = powMod(root, p - 2, p);
+        }
+        uint32_t step = mg.to(root);
+        w[0] = mg.to(1);
+        for(int j = 1; j < len / 2; j++){
+            w[j] = mg.mul(w[j - 1], step);
+        }
+        for(int i = 0; i < n; i += len){
+            for(int j = 0; j < len / 2; j++){
+                uint32_t u = a[i + j], v = mg.mul(a[i + j + len / 2], w[j]);
+                a[i + j] = u + v >= p ? u + v - p : u + v;
+                a[i + j + len / 2] = u >= v ? u - v : u + p - v;
+            }
+        }
+    }
+    if(invert){
+        uint32_t scale = mg.to(powMod(n, p - 2, p));
+        for(int i = 0; i < n; i++){
+            a[i] = mg.mul(a[i], scale);
+        }
+    }
+}
+
+// cyclic product of two sequences already reduced modulo prime k; the
+// padded length must divide p - 1, which nttLimit guarantees for all three
+vector<uint32_t> nttMult(const vector<uint32_t> &poly1, const vector<uint32_t> &poly2, int k){
+    const montgomery mg(nttPrimes[k]);
+    size_t size = poly1.size() + poly2.size() - 1, n = 1;
+    while(n < size){
+        n <<= 1;
+    }
+    vector<uint32_t> a(n, 0), b(n, 0);
+    for(size_t i = 0; i < poly1.size(); i++){
+        a[i] = mg.to(poly1[i]);
+    }
+    for(size_t i = 0; i < poly2.size(); i++){
+        b[i] = mg.to(poly2[i]);
+    }
+    ntt(a, false, k);
+    ntt(b, false, k);
+    for(size_t i = 0; i < n; i++){
+        a[i] = mg.mul(a[i], b[i]);
+    }
+    ntt(a, true, k);
+    a.resize(size);
+    for(size_t i = 0; i < size; i++){
+        a[i] = mg.from(a[i]);
+    }
+    return a;
+}
+
+// residues of a product modulo each of the three primes, for inputs
+// given as residues modulo each prime
+void nttMult3(vector<uint32_t> (&in1)[3], vector<uint32_t> (&in2)[3], vector<uint32_t> (&out)[3]){
+    for(int k = 0; k < 3; k++){
+        out[k] = nttMult(in1[k], in2[k], k);
+    }
+}
+
+// x mod the product of the three primes, as (r0, t1, t2) digits with
+// x = r0 + m0 * t1 + m0 * m1 * t2
+void garner(uint32_t r0, uint32_t r1, uint32_t r2, uint64_t &t1, uint64_t &t2){
+    static const uint64_t m0 = nttPrimes[0], m1 = nttPrimes[1], m2 = nttPrimes[2];
+    static const uint64_t i01 = powMod(m0, m1 - 2, m1), i012 = powMod(m0 * m1 % m2, m2 - 2, m2);
+    t1 = (r1 + m1 - r0 % m1) % m1 * i01 % m1;
+    uint64_t x = (r0 % m2 + m0 % m2 * t1) % m2;
+    t2 = (r2 + m2 - x) % m2 * i012 % m2;
+}
+
+// coefficients of a float polynomial rounded and reduced modulo p
+vector<uint32_t> polyToMod(vector<float> poly, uint32_t p){
+    vector<uint32_t> newPoly(poly.size());
+    for(size_t i = 0; i < poly.size(); i++){
+        long long c = llround(poly[i]) % static_cast<long long>(p);
+        newPoly[i] = static_cast<uint32_t>(c < 0 ? c + p : c);
+    }
+    return newPoly;
+}
+
+// back to floats, taking the representative closest to zero
+vector<float> polyFromMod(vector<uint32_t> poly, uint32_t p){
+    vector<float> newPoly(poly.size());
+    for(size_t i = 0; i < poly.size(); i++){
+        newPoly[i] = poly[i] > p / 2 ? -static_cast<float>(p - poly[i]) : static_cast<float>(poly[i]);
+    }
+    return newPoly;
+}
+
+vector<uint32_t> polyAddMod(vector<uint32_t> poly1, vector<uint32_t> poly2, uint32_t p){
+    // adds two polynomials modulo p
+    if(poly1.size() < poly2.size()){
+        swap(poly1, poly2);
+    }
+    for(size_t i = 0; i < poly2.size(); i++){
+        uint64_t c = static_cast<uint64_t>(poly1[i]) + poly2[i];
+        poly1[i] = static_cast<uint32_t>(c >= p ? c - p : c);
+    }
+    return poly1;
+}
+vector<uint32_t> polySubMod(vector<uint32_t> poly1, vector<uint32_t> poly2, uint32_t p){
+    // subtracts two polynomials modulo p
+    poly1.resize(max(poly1.size(), poly2.size()), 0);
+    for(size_t i = 0; i < poly2.size(); i++){
+        poly1[i] = poly1[i] >= poly2[i] ? poly1[i] - poly2[i] : static_cast<uint32_t>(poly1[i] + static_cast<uint64_t>(p) - poly2[i]);
+    }
+    return poly1;
+}
+vector<uint32_t> polyMultMod(vector<uint32_t> poly1, vector<uint32_t> poly2, uint32_t p){
+    // multiplies two polynomials modulo p
+    PROFILE_SCOPE("polyMultMod", 0, 0);
+    if(poly1.empty() || poly2.empty()){
+        return vector<uint32_t> {0};
+    }
+    size_t size = poly1.size() + poly2.size() - 1;
+    if(min(poly1.size(), poly2.size()) <= 32){
+        const barrett br(p);
+        vector<uint32_t> newPoly(size, 0);
+        for(size_t x1 = 0; x1 < poly1.size(); x1++){
+            for(size_t x2 = 0; x2 < poly2.size(); x2++){
+                uint64_t c = static_cast<uint64_t>(newPoly[x1 + x2]) + br.reduce(static_cast<uint64_t>(poly1[x1]) * poly2[x2]);
+                newPoly[x1 + x2] = static_cast<uint32_t>(c >= p ? c - p : c);
+            }
+        }
+        return newPoly;
+    }
+    for(int k = 0; k < 3; k++){
+        if(p == nttPrimes[k] && ((p - 1) & -(p - 1)) >= size){
+            return nttMult(poly1, poly2, k);
+        }
+    }
+    if(size > nttLimit){
+        // too long for one transform: split the longer factor in half
+        if(poly1.size() < poly2.size()){
+            swap(poly1, poly2);
+        }
+        size_t h = poly1.size() / 2;
+        vector<uint32_t> low = polyMultMod(vector<uint32_t>(poly1.begin(), poly1.begin() + h), poly2, p);
+        vector<uint32_t> high = polyMultMod(vector<uint32_t>(poly1.begin() + h, poly1.end()), poly2, p);
+        high.insert(high.begin(), h, 0);
+        return polyAddMod(low, high, p);
+    }
+    // the exact coefficients have to stay below the product of the three
+    // primes, about 2^86, to come back through the chinese remainder
+    // theorem. If they might not, each coefficient is split into 16 bit
+    // halves and the product is put together from three products of
+    // halves, whose coefficients are far smaller
+    uint64_t max1 = *max_element(poly1.begin(), poly1.end()), max2 = *max_element(poly2.begin(), poly2.end());
+    unsigned __int128 all = static_cast<unsigned __int128>(nttPrimes[0]) * nttPrimes[1] * nttPrimes[2];
+    if(static_cast<unsigned __int128>(min(poly1.size(), poly2.size())) * max1 * max2 >= all){
+        vector<uint32_t> lo1(poly1.size()), hi1(poly1.size()), lo2(poly2.size()), hi2(poly2.size());
+        for(size_t i = 0; i < poly1.size(); i++){
+            lo1[i] = poly1[i] & 0xffff;
+            hi1[i] = poly1[i] >> 16;
+        }
+        for(size_t i = 0; i < poly2.size(); i++){
+            lo2[i] = poly2[i] & 0xffff;
+            hi2[i] = poly2[i] >> 16;
+        }
+        vector<uint32_t> low = polyMultMod(lo1, lo2, p), high = polyMultMod(hi1, hi2, p);
+        for(size_t i = 0; i < poly1.size(); i++){
+            lo1[i] += hi1[i];
+        }
+        for(size_t i = 0; i < poly2.size(); i++){
+            lo2[i] += hi2[i];
+        }
+        vector<uint32_t> mid = polySubMod(polySubMod(polyMultMod(lo1, lo2, p), low, p), high, p);
+        const barrett br(p);
+        uint64_t s16 = (1ull << 16) % p, s32 = (1ull << 32) % p;
+        vector<uint32_t> newPoly(size);
+        for(size_t i = 0; i < size; i++){
+            uint64_t c = static_cast<uint64_t>(low[i]) + br.reduce(mid[i] * s16) + br.reduce(high[i] * s32);
+            newPoly[i] = static_cast<uint32_t>(c % p);
+        }
+        return newPoly;
+    }
+    vector<uint32_t> in1[3], in2[3], out[3];
+    for(int k = 0; k < 3; k++){
+        in1[k] = poly1;
+        in2[k] = poly2;
+        for(uint32_t &c : in1[k]){
+            c %= nttPrimes[k];
+        }
+        for(uint32_t &c : in2[k]){
+            c %= nttPrimes[k];
+        }
+    }
+    nttMult3(in1, in2, out);
+    const barrett br(p);
+    uint64_t m0 = nttPrimes[0] % p, m01 = static_cast<uint64_t>(nttPrimes[0]) * nttPrimes[1] % p;
+    vector<uint32_t> newPoly(size);
+    for(size_t i = 0; i < size; i++){
+        uint64_t t1, t2;
+        garner(out[0][i], out[1][i], out[2][i], t1, t2);
+        uint64_t c = static_cast<uint64_t>(out[0][i] % p) + br.reduce(m0 * (t1 % p)) + br.reduce(m01 * (t2 % p));
+        newPoly[i] = static_cast<uint32_t>(c % p);
+    }
+    return newPoly;
+}
+vector<uint32_t> polyPowMod(vector<uint32_t> poly, int power, uint32_t p){
+    // raises polynomial to a positive power modulo p by squaring
+    PROFILE_SCOPE("polyPowMod", 0, 0);
+    vector<uint32_t> newPoly {1 % p};
+    for(; power > 0; power >>= 1){
+        if(power & 1){
+            newPoly = polyMultMod(newPoly, poly, p);
+        }
+        if(power > 1){
+            poly = polyMultMod(poly, poly, p);
+        }
+    }
+    return newPoly;
+}
+vector<uint32_t> polyDerivMod(vector<uint32_t> poly, uint32_t p){
+    // derives polynomial modulo p
+    if(poly.size() < 2){
+        return vector<uint32_t> {0};
+    }
+    vector<uint32_t> newPoly(poly.size() - 1);
+    for(size_t i = 1; i < poly.size(); i++){
+        newPoly[i - 1] = static_cast<uint32_t>(static_cast<uint64_t>(poly[i]) * (i % p) % p);
+    }
+    return newPoly;
+}
+vector<uint32_t> polyIntegMod(vector<uint32_t> poly, uint32_t p){
+    // integrates polynomial modulo a prime p larger than its degree
+    vector<uint32_t> newPoly(poly.size() + 1, 0);
+    for(size_t i = 0; i < poly.size(); i++){
+        newPoly[i + 1] = static_cast<uint32_t>(static_cast<uint64_t>(poly[i]) * powMod(i + 1, p - 2, p) % p);
+    }
+    return newPoly;
+}
+uint32_t polyAtMod(vector<uint32_t> poly, uint32_t x, uint32_t p){
+    // returns the value of y at x modulo p
+    uint64_t value = 0;
+    for(int i = static_cast<int>(poly.size()) - 1; i >= 0; i--){
+        value = (value * x + poly[i]) % p;
+    }
+    return static_cast<uint32_t>(value);
+}
+vector<long long> polyMultExact(vector<long long> poly1, vector<long long> poly2){
+    // exact integer product, good while every coefficient of the result
+    // stays within a signed 64 bit integer
+    PROFILE_SCOPE("polyMultExact", 0, 0);
+    if(poly1.empty() || poly2.empty()){
+        return vector<long long> {0};
+    }
+    if(poly1.size() + poly2.size() - 1 > nttLimit){
+        // too long for one transform: split the longer factor in half
+        if(poly1.size() < poly2.size()){
+            swap(poly1, poly2);
+        }
+        size_t h = poly1.size() / 2;
+        vector<long long> newPoly = polyMultExact(vector<long long>(poly1.begin(), poly1.begin() + h), poly2);
+        vector<long long> high = polyMultExact(vector<long long>(poly1.begin() + h, poly1.end()), poly2);
+        newPoly.resize(poly1.size() + poly2.size() - 1, 0);
+        for(size_t i = 0; i < high.size(); i++){
+            newPoly[h + i] += high[i];
+        }
+        return newPoly;
+    }
+    vector<uint32_t> in1[3], in2[3], out[3];
+    for(int k = 0; k < 3; k++){
+        long long m = nttPrimes[k];
+        for(long long c : poly1){
+            in1[k].push_back(static_cast<uint32_t>((c % m + m) % m));
+        }
+        for(long long c : poly2){
+            in2[k].push_back(static_cast<uint32_t>((c % m + m) % m));
+        }
+    }
+    nttMult3(in1, in2, out);
+    __int128 m0 = nttPrimes[0], m01 = m0 * nttPrimes[1], all = m01 * nttPrimes[2];
+    vector<long long> newPoly(out[0].size());
+    for(size_t i = 0; i < newPoly.size(); i++){
+        uint64_t t1, t2;
+        garner(out[0][i], out[1][i], out[2][i], t1, t2);
+        __int128 x = out[0][i] + m0 * t1 + m01 * t2;
+        newPoly[i] = static_cast<long long>(x > all / 2 ? x - all : x);
+    }
+    return newPoly;
+}
+
+// polynomial division
+// Long division costs (n - m) * m, which is fine for small quotients or
+// divisors. Past that the quotient comes from the reversed polynomials:
+// rev(a) / rev(b) is a power series whose first n - m + 1 terms are
+// rev(q), and 1 / rev(b) is found by Newton iteration, doubling the
+// number of correct terms each step with two fast products. Products
+// here go through a double precision FFT once both sides are big.
+// GCDs of float polynomials use Euclid with a tolerance, since exact
+// cancellation cannot be trusted; over Z/p they are exact and use the
+// half-GCD, which finds the remainder sequence halfway point from the
+// top halves of the coefficients alone.
+
+// sizes below which the plain algorithms win
+const size_t polyFastMult = 64, polyFastDiv = 64, polyFastGcd = 64;
+
+// radix-2 transform in place, a.size() a power of two
+void polyFFT(vector<complex<double>> &a, bool invert){
+    int n = static_cast<int>(a.size());
+    for(int i = 1, j = 0; i < n; i++){
+        int bit = n >> 1;
+        for(; j & bit; bit >>= 1){
+            j ^= bit;
+        }
+        j ^= bit;
+        if(i < j){
+            swap(a[i], a[j]);
+        }
+    }
+    // roots of unity for the full length, every level takes a stride
+    vector<complex<double>> root(n / 2);
+    for(int j = 0; j < n / 2; j++){
+        root[j] = polar(1.0, (invert ? 2 : -2) * M_PI * j / n);
+    }
+    for(int len = 2; len <= n; len <<= 1){
+        for(int j = 0; j < len / 2; j++){
+            complex<double> w = root[j * (n / len)];
+            for(int i = j; i < n; i += len){
+                complex<double> u = a[i], v = a[i + len / 2] * w;
+                a[i] = u + v;
+                a[i + len / 2] = u - v;
+            }
+        }
+    }
+    if(invert){
+        for(complex<double> &c : a){
+            c /= n;
+        }
+    }
+}
+
+vector<float> polyMultFast(vector<float> poly1, vector<float> poly2){
+    // multiplies two polynomials, by FFT when both are large
+    PROFILE_SCOPE("polyMultFast", 0, 0);
+    if(min(poly1.size(), poly2.size()) < polyFastMult){
+        return polyMult(poly1, poly2);
+    }
+    size_t size = poly1.size() + poly2.size() - 1, n = 1;
+    while(n < size){
+        n <<= 1;
+    }
+    // both inputs ride in one transform, as real and imaginary parts
+    vector<complex<double>> a(n);
+    for(size_t i = 0; i < poly1.size(); i++){
+        a[i].real(poly1[i]);
+    }
+    for(size_t i = 0; i < poly2.size(); i++){
+        a[i].imag(poly2[i]);
+    }
+    polyFFT(a, false);
+    vector<complex<double>> b(n);
+    for(size_t i = 0; i < n; i++){
+        complex<double> x = a[i], y = conj(a[(n - i) & (n - 1)]);
+        b[i] = (x + y) * (x - y) * complex<double>(0, -0.25);
+    }
+    polyFFT(b, true);
+    vector<float> newPoly(size);
+    for(size_t i = 0; i < size; i++){
+        newPoly[i] = static_cast<float>(b[i].real());
+    }
+    return newPoly;
+}
+
+// drops zero terms above the leading one, keeping at least one term
+vector<float> polyTrim(vector<float> poly){
+    while(poly.size() > 1 && poly.back() == 0){
+        poly.pop_back();
+    }
+    if(poly.empty()){
+        poly.push_back(0);
+    }
+    return poly;
+}
+
+vector<float> polyInverse(vector<float> poly, size_t n){
+    // first n terms of the power series 1 / poly, poly[0] nonzero
+    vector<float> inv {1 / poly[0]};
+    for(size_t k = 1; k < n; k <<= 1){
+        // inv = inv * (2 - poly * inv) to 2k terms
+        vector<float> head(poly.begin(), poly.begin() + min(poly.size(), 2 * k));
+        vector<float> e = polyMultFast(head, inv);
+        e.resize(2 * k, 0);
+        for(float &c : e){
+            c = -c;
+        }
+        e[0] += 2;
+        inv = polyMultFast(inv, e);
+        inv.resize(2 * k);
+    }
+    inv.resize(n);
+    return inv;
+}
+
+void polyDivRem(vector<float> poly1, vector<float> poly2, vector<float> &quot, vector<float> &rem){
+    // divides poly1 by poly2, dividing by zero leaves poly1 as remainder
+    PROFILE_SCOPE("polyDivRem", 0, 0);
+    poly1 = polyTrim(poly1);
+    poly2 = polyTrim(poly2);
+    size_t n = poly1.size(), m = poly2.size();
+    if(n < m || (m == 1 && poly2[0] == 0)){
+        quot = vector<float> {0};
+        rem = poly1;
+        return;
+    }
+    size_t k = n - m + 1;
+    if(k < polyFastDiv || m < polyFastDiv){
+        // long division
+        quot.assign(k, 0);
+        for(size_t i = k; i-- > 0;){
+            float c = poly1[i + m - 1] / poly2[m - 1];
+            quot[i] = c;
+            for(size_t j = 0; j < m; j++){
+                poly1[i + j] -= c * poly2[j];
+            }
+        }
+        poly1.resize(m - 1);
+        rem = polyTrim(poly1);
+        return;
+    }
+    vector<float> ra(poly1.rbegin(), poly1.rbegin() + k), rb(poly2.rbegin(), poly2.rend());
+    vector<float> q = polyMultFast(ra, polyInverse(rb, k));
+    q.resize(k);
+    quot.assign(q.rbegin(), q.rend());
+    vector<float> r = polySub(poly1, polyMultFast(poly2, quot));
+    r.resize(m - 1);
+    rem = polyTrim(r);
+}
+vector<float> polyDiv(vector<float> poly1, vector<float> poly2){
+    // quotient of poly1 / poly2
+    vector<float> quot, rem;
+    polyDivRem(poly1, poly2, quot, rem);
+    return quot;
+}
+vector<float> polyRem(vector<float> poly1, vector<float> poly2){
+    // remainder of poly1 / poly2
+    vector<float> quot, rem;
+    polyDivRem(poly1, poly2, quot, rem);
+    return rem;
+}
+vector<float> polyGcd(vector<float> poly1, vector<float> poly2, float eps = 1e-4f){
+    // monic greatest common divisor, treating terms smaller than eps
+    // times the largest coefficient of a step as zero
+    PROFILE_SCOPE("polyGcd", 0, 0);
+    auto clean = [eps](vector<float> poly, float scale){
+        for(float &c : poly){
+            if(abs(c) <= eps * scale){
+                c = 0;
+            }
+        }
+        return polyTrim(poly);
+    };
+    poly1 = polyTrim(poly1);
+    poly2 = polyTrim(poly2);
+    while(!(poly2.size() == 1 && poly2[0] == 0)){
+        float scale = 0;
+        for(float c : poly1){
+            scale = max(scale, abs(c));
+        }
+        vector<float> rem = clean(polyRem(poly1, poly2), scale);
+        poly1 = poly2;
+        poly2 = rem;
+    }
+    if(poly1.back()){
+        float lead = poly1.back();
+        for(float &c : poly1){
+            c /= lead;
+        }
+    }
+    return poly1;
+}
+
+// zero terms dropped from the top, the zero polynomial left empty
+vector<uint32_t> polyTrimMod(vector<uint32_t> poly){
+    while(!poly.empty() && poly.back() == 0){
+        poly.pop_back();
+    }
+    return poly;
+}
+
+vector<uint32_t> polyInverseMod(vector<uint32_t> poly, size_t n, uint32_t p){
+    // first n terms of the power series 1 / poly modulo a prime p
+    vector<uint32_t> inv {powMod(poly[0], p - 2, p)};
+    for(size_t k = 1; k < n; k <<= 1){
+        vector<uint32_t> head(poly.begin(), poly.begin() + min(poly.size(), 2 * k));
+        vector<uint32_t> e = polyMultMod(head, inv, p);
+        e.resize(2 * k, 0);
+        e = polySubMod(vector<uint32_t> {2 % p}, e, p);
+        inv = polyMultMod(inv, e, p);
+        inv.resize(2 * k);
+    }
+    inv.resize(n);
+    return inv;
+}
+
+void polyDivRemMod(vector<uint32_t> poly1, vector<uint32_t> poly2, uint32_t p, vector<uint32_t> &quot, vector<uint32_t> &rem){
+    // divides poly1 by a nonzero poly2 modulo a prime p, results trimmed
+    PROFILE_SCOPE("polyDivRemMod", 0, 0);
+    poly1 = polyTrimMod(poly1);
+    poly2 = polyTrimMod(poly2);
+    size_t n = poly1.size(), m = poly2.size();
+    if(n < m || m == 0){
+        quot.clear();
+        rem = poly1;
+        return;
+    }
+    size_t k = n - m + 1;
+    if(k < polyFastDiv || m < polyFastDiv){
+        const barrett br(p);
+        uint64_t inv = powMod(poly2[m - 1], p - 2, p);
+        quot.assign(k, 0);
+        for(size_t i = k; i-- > 0;){
+            uint32_t c = br.reduce(poly1[i + m - 1] * inv);
+            quot[i] = c;
+            for(size_t j = 0; j < m; j++){
+                uint32_t t = br.reduce(static_cast<uint64_t>(c) * poly2[j]);
+                poly1[i + j] = poly1[i + j] >= t ? poly1[i + j] - t : static_cast<uint32_t>(poly1[i + j] + static_cast<uint64_t>(p) - t);
+            }
+        }
+        poly1.resize(m - 1);
+        rem = polyTrimMod(poly1);
+        return;
+    }
+    vector<uint32_t> ra(poly1.rbegin(), poly1.rbegin() + k), rb(poly2.rbegin(), poly2.rend());
+    vector<uint32_t> q = polyMultMod(ra, polyInverseMod(rb, k, p), p);
+    q.resize(k);
+    quot.assign(q.rbegin(), q.rend());
+    vector<uint32_t> r = polySubMod(poly1, polyMultMod(poly2, quot, p), p);
+    r.resize(m - 1);
+    rem = polyTrimMod(r);
+}
+
+// 2x2 matrix of polynomials over Z/p, the product of remainder steps
+struct polyStepMod {
+    vector<uint32_t> m[2][2];
+    polyStepMod(){
+        m[0][0] = m[1][1] = vector<uint32_t> {1};
+    }
+};
+
+// deg with the zero polynomial at -1
+int polyDegMod(const vector<uint32_t> &poly){
+    return static_cast<int>(poly.size()) - 1;
+}
+
+// poly / x^k, dropping the low terms
+vector<uint32_t> polyShiftMod(const vector<uint32_t> &poly, int k){
+    if(static_cast<int>(poly.size()) <= k){
+        return vector<uint32_t> {};
+    }
+    return vector<uint32_t>(poly.begin() + k, poly.end());
+}
+
+// (a, b) = S (a, b)
+void polyApplyMod(const polyStepMod &S, vector<uint32_t> &a, vector<uint32_t> &b, uint32_t p){
+    vector<uint32_t> c = polyAddMod(polyMultMod(S.m[0][0], a, p), polyMultMod(S.m[0][1], b, p), p);
+    vector<uint32_t> d = polyAddMod(polyMultMod(S.m[1][0], a, p), polyMultMod(S.m[1][1], b, p), p);
+    a = polyTrimMod(c);
+    b = polyTrimMod(d);
+}
+
+// S T
+polyStepMod polyComposeMod(const polyStepMod &S, const polyStepMod &T, uint32_t p){
+    polyStepMod R;
+    for(int i = 0; i < 2; i++){
+        for(int j = 0; j < 2; j++){
+            R.m[i][j] = polyTrimMod(polyAddMod(polyMultMod(S.m[i][0], T.m[0][j], p), polyMultMod(S.m[i][1], T.m[1][j], p), p));
+        }
+    }
+    return R;
+}
+
+// for deg a > deg b, the steps taking (a, b) to the consecutive
+// remainders (c, d) with deg c >= ceil(deg a / 2) > deg d
+polyStepMod polyHalfGcdMod(vector<uint32_t> a, vector<uint32_t> b, uint32_t p){
+    int m = (polyDegMod(a) + 1) / 2;
+    polyStepMod R;
+    if(polyDegMod(b) < m){
+        return R;
+    }
+    vector<uint32_t> q, r;
+    polyStepMod Q;
+    Q.m[0][0] = vector<uint32_t> {};
+    Q.m[0][1] = Q.m[1][0] = vector<uint32_t> {1};
+    if(a.size() < polyFastGcd){
+        // small enough to take the remainder steps one at a time
+        while(polyDegMod(b) >= m){
+            polyDivRemMod(a, b, p, q, r);
+            Q.m[1][1] = polySubMod(vector<uint32_t> {}, q, p);
+            R = polyComposeMod(Q, R, p);
+            a = b;
+            b = r;
+        }
+        return R;
+    }
+    R = polyHalfGcdMod(polyShiftMod(a, m), polyShiftMod(b, m), p);
+    polyApplyMod(R, a, b, p);
+    if(polyDegMod(b) < m){
+        return R;
+    }
+    polyDivRemMod(a, b, p, q, r);
+    Q.m[1][1] = polySubMod(vector<uint32_t> {}, q, p);
+    R = polyComposeMod(Q, R, p);
+    a = b;
+    b = r;
+    if(polyDegMod(b) < m){
+        return R;
+    }
+    int k = 2 * m - polyDegMod(a);
+    return polyComposeMod(polyHalfGcdMod(polyShiftMod(a, k), polyShiftMod(b, k), p), R, p);
+}
+
+vector<uint32_t> polyGcdMod(vector<uint32_t> poly1, vector<uint32_t> poly2, uint32_t p){
+    // monic greatest common divisor modulo a prime p, {0} if both are zero
+    PROFILE_SCOPE("polyGcdMod", 0, 0);
+    poly1 = polyTrimMod(poly1);
+    poly2 = polyTrimMod(poly2);
+    if(poly1.size() < poly2.size()){
+        swap(poly1, poly2);
+    }
+    vector<uint32_t> q, r;
+    while(!poly2.empty()){
+        if(poly1.size() == poly2.size()){
+            polyDivRemMod(poly1, poly2, p, q, r);
+            poly1 = poly2;
+            poly2 = r;
+            continue;
+        }
+        if(poly1.size() >= polyFastGcd){
+            polyApplyMod(polyHalfGcdMod(poly1, poly2, p), poly1, poly2, p);
+            if(poly2.empty()){
+                break;
+            }
+        }
+        polyDivRemMod(poly1, poly2, p, q, r);
+        poly1 = poly2;
+        poly2 = r;
+    }
+    if(poly1.empty()){
+        return vector<uint32_t> {0};
+    }
+    uint64_t inv = powMod(poly1.back(), p - 2, p);
+    for(uint32_t &c : poly1){
+        c = static_cast<uint32_t>(c * inv % p);
+    }
+    return poly1;
+}
+
+// composition and taylor shifts
+// p(q(x)) splits p into halves, p = lo + x^h hi, so that
+// p(q) = lo(q) + q^h hi(q). The powers q^(2^j) are made once and every
+// level of the recursion is a handful of fast products, so the whole
+// composition costs a log factor over one product of the result's size.
+// A Taylor shift p(x + a) is the composition with x + a, and its
+// coefficients are the derivatives at a over k!. Over Z/p the shift is a
+// single product instead, from
+// k! b_k = sum over i of (i! p_i) (a^(i - k) / (i - k)!),
+// which needs factorials that floats cannot hold past a few dozen terms.
+
+// lengths below which composition is plain Horner
+const size_t polyFastCompose = 16;
+
+// poly[b, b + len) composed with q, qpow[j] = q^(2^j)
+vector<float> polyComposeRange(const vector<float> &poly, size_t b, size_t len, const vector<vector<float>> &qpow){
+    if(len <= polyFastCompose){
+        vector<float> value {poly[b + len - 1]};
+        for(size_t i = b + len - 1; i-- > b;){
+            value = polyMultFast(value, qpow[0]);
+            value[0] += poly[i];
+        }
+        return value;
+    }
+    size_t half = len / 2, j = 0;
+    while(static_cast<size_t>(1) << j < half){
+        j++;
+    }
+    vector<float> lo = polyComposeRange(poly, b, half, qpow);
+    vector<float> value = polyMultFast(polyComposeRange(poly, b + half, half, qpow), qpow[j]);
+    for(size_t i = 0; i < lo.size(); i++){
+        value[i] += lo[i];
+    }
+    return value;
+}
+vector<float> polyCompose(vector<float> poly1, vector<float> poly2){
+    // returns poly1(poly2(x))
+    PROFILE_SCOPE("polyCompose", 0, 0);
+    poly1 = polyTrim(poly1);
+    poly2 = polyTrim(poly2);
+    if(poly1.size() == 1 || poly2.size() == 1){
+        return vector<float> {polyAt(poly1, poly2[0])};
+    }
+    size_t size = (poly1.size() - 1) * (poly2.size() - 1) + 1, len = 1;
+    while(len < poly1.size()){
+        len <<= 1;
+    }
+    poly1.resize(len, 0);
+    vector<vector<float>> qpow {poly2};
+    for(size_t h = 1; 2 * h < len; h <<= 1){
+        qpow.push_back(polyMultFast(qpow.back(), qpow.back()));
+    }
+    vector<float> value = polyComposeRange(poly1, 0, len, qpow);
+    value.resize(size);
+    return polyTrim(value);
+}
+vector<float> polyTaylorShift(vector<float> poly, float a){
+    // returns poly(x + a), the expansion of poly in powers of (x - a)
+    return polyCompose(poly, vector<float> {a, 1});
+}
+vector<float> polyDerivsAt(vector<float> poly, float x){
+    // every derivative at x at once, the value first
+    vector<float> derivs = polyTaylorShift(poly, x);
+    float fact = 1;
+    for(size_t k = 1; k < derivs.size(); k++){
+        fact *= k;
+        derivs[k] *= fact;
+    }
+    return derivs;
+}
+vector<uint32_t> polyTaylorShiftMod(vector<uint32_t> poly, uint32_t a, uint32_t p){
+    // returns poly(x + a) modulo a prime p larger than the degree
+    PROFILE_SCOPE("polyTaylorShiftMod", 0, 0);
+    size_t n = poly.size();
+    if(n < 2){
+        return poly;
+    }
+    vector<uint32_t> fact(n), inv(n), u(n), v(n);
+    fact[0] = 1;
+    for(size_t i = 1; i < n; i++){
+        fact[i] = static_cast<uint32_t>(static_cast<uint64_t>(fact[i - 1]) * i % p);
+    }
+    inv[n - 1] = powMod(fact[n - 1], p - 2, p);
+    for(size_t i = n - 1; i > 0; i--){
+        inv[i - 1] = static_cast<uint32_t>(static_cast<uint64_t>(inv[i]) * i % p);
+    }
+    uint64_t power = 1;
+    for(size_t i = 0; i < n; i++){
+        // u reversed so the sum over i - k becomes a product
+        u[n - 1 - i] = static_cast<uint32_t>(static_cast<uint64_t>(poly[i]) * fact[i] % p);
+        v[i] = static_cast<uint32_t>(power * inv[i] % p);
+        power = power * a % p;
+    }
+    vector<uint32_t> w = polyMultMod(u, v, p), newPoly(n);
+    for(size_t k = 0; k < n; k++){
+        newPoly[k] = static_cast<uint32_t>(static_cast<uint64_t>(w[n - 1 - k]) * inv[k] % p);
+    }
+    return newPoly;
+}
+
+// prepared definite integrals
+// polyIntegral keeps the antiderivative of one polynomial, in double
+// precision, and answers batches of [a, b] integrals. Points are taken
+// in groups of polyLanes so that the Horner steps of one group run side
+// by side and vectorize, and batches past polyParallel queries are split
+// over the shared thread pool. Histograms over adjacent bins only need
+// the antiderivative once per edge.
+
+const int polyLanes = 8, polyParallel = 1 << 14;
+
+class polyIntegral {
+public:
+    polyIntegral(vector<float> poly = vector<float> {0}){
+        anti.assign(poly.size() + 1, 0);
+        for(size_t i = 0; i < poly.size(); i++){
+            anti[i + 1] = static_cast<double>(poly[i]) / (i + 1);
+        }
+    }
+
+    // antiderivative at x, zero at 0
+    double at(double x) const {
+        double value = 0;
+        for(size_t i = anti.size(); i-- > 0;){
+            value = value * x + anti[i];
+        }
+        return value;
+    }
+
+    // integral from a to b
+    float operator()(float a, float b) const {
+        return static_cast<float>(at(b) - at(a));
+    }
+
+    // out[i] = integral from a[i] to b[i], for i < n
+    void eval(const float * a, const float * b, float * out, int n) const {
+        PROFILE_SCOPE("polyIntegral::eval", 4 * static_cast<uint64_t>(n) * anti.size(), 0);
+        parallelFor(n, polyParallel, [&](int begin, int end){
+            double fa[polyLanes], fb[polyLanes];
+            for(int i = begin; i < end; i += polyLanes){
+                int k = min(polyLanes, end - i);
+                horner(a + i, fa, k);
+                horner(b + i, fb, k);
+                for(int j = 0; j < k; j++){
+                    out[i + j] = static_cast<float>(fb[j] - fa[j]);
+                }
+            }
+        });
+    }
+
+    // out[i] = integral over the bin [edges[i], edges[i + 1]], for i < n
+    void bins(const float * edges, float * out, int n) const {
+        PROFILE_SCOPE("polyIntegral::bins", 2 * static_cast<uint64_t>(n) * anti.size(), 0);
+        parallelFor(n, polyParallel, [&](int begin, int end){
+            double f[polyLanes + 1];
+            horner(edges + begin, f, 1);
+            for(int i = begin; i < end; i += polyLanes){
+                int k = min(polyLanes, end - i);
+                horner(edges + i + 1, f + 1, k);
+                for(int j = 0; j < k; j++){
+                    out[i + j] = static_cast<float>(f[j + 1] - f[j]);
+                }
+                f[0] = f[k];
+            }
+        });
+    }
+
+private:
+    vector<double> anti;
+
+    // antiderivative at k <= polyLanes points, one Horner step for all
+    // lanes at a time
+    void horner(const float * x, double * f, int k) const {
+        double lane[polyLanes], value[polyLanes] = {};
+        for(int j = 0; j < polyLanes; j++){
+            lane[j] = j < k ? x[j] : 0;
+        }
+        for(size_t i = anti.size(); i-- > 0;){
+            double c = anti[i];
+            for(int j = 0; j < polyLanes; j++){
+                value[j] = value[j] * lane[j] + c;
+            }
+        }
+        for(int j = 0; j < k; j++){
+            f[j] = value[j];
+        }
+    }
+};
+
+// memoized polynomial operations
+// Results of polyMult, polyPow, polyInteg and polyParse are kept in a
+// bounded cache keyed by the operation and its inputs. Inputs are made
+// canonical before both keying and computing (trailing zero terms
+// dropped, -0 read as 0) so equal polynomials share an entry with the
+// same result, and text is keyed as given. Keys are hashed 8 bytes at
+// a time. The cache is split into shards, each with its own
+// lock and least recently used list, and evicts from the cold end of a
+// shard once it goes over its share of the memory budget.
+class polyCache {
+public:
+    polyCache(size_t budget = 64 << 20){
+        limit = budget;
+    }
+
+    // result for an operation on canonical inputs, computing it on a miss
+    template <typename F>
+    shared_ptr<const vector<float>> get(const string &key, F compute){
+        uint64_t h = hash(key);
+        shard &s = shards[h % shardCount];
+        {
+            lock_guard<mutex> l(s.lock);
+            auto found = s.index.find(h);
+            if(found != s.index.end() && found->second->key == key){
+                s.order.splice(s.order.begin(), s.order, found->second);
+                hits++;
+                return found->second->value;
+            }
+        }
+        misses++;
+        shared_ptr<const vector<float>> value = make_shared<const vector<float>>(compute());
+        size_t size = key.size() + value->size() * sizeof(float) + sizeof(entry) + 64;
+        lock_guard<mutex> l(s.lock);
+        auto found = s.index.find(h);
+        if(found != s.index.end()){
+            // another thread got there first, or a colliding key; replace it
+            s.bytes -= found->second->size;
+            s.order.erase(found->second);
+            s.index.erase(found);
+        }
+        if(size > limit / shardCount){
+            return value;
+        }
+        s.order.push_front(entry {key, value, size, h});
+        s.index[h] = s.order.begin();
+        s.bytes += size;
+        while(s.bytes > limit / shardCount){
+            entry &cold = s.order.back();
+            s.bytes -= cold.size;
+            s.index.erase(cold.hash);
+            s.order.pop_back();
+            evictions++;
+        }
+        return value;
+    }
+
+    // drops every entry and changes the memory budget
+    void resize(size_t budget){
+        for(shard &s : shards){
+            lock_guard<mutex> l(s.lock);
+            s.order.clear();
+            s.index.clear();
+            s.bytes = 0;
+        }
+        limit = budget;
+    }
+
+    // bytes held across all shards
+    size_t bytes(){
+        size_t total = 0;
+        for(shard &s : shards){
+            lock_guard<mutex> l(s.lock);
+            total += s.bytes;
+        }
+        return total;
+    }
+
+    atomic<uint64_t> hits {0}, misses {0}, evictions {0};
+
+    // canonical form: trailing zero terms dropped and -0 made 0, so that
+    // inputs with the same key also give the same result
+    static vector<float> canonical(vector<float> poly){
+        size_t n = poly.size();
+        while(n > 1 && poly[n - 1] == 0){
+            n--;
+        }
+        poly.resize(n);
+        for(float &c : poly){
+            if(c == 0){
+                c = 0.0f;
+            }
+        }
+        return poly;
+    }
+
+    // key material of a polynomial already in canonical form
+    static void append(string &key, const vector<float> &poly){
+        uint32_t count = static_cast<uint32_t>(poly.size());
+        key.append(reinterpret_cast<const char *>(&count), sizeof(count));
+        for(float c : poly){
+            key.append(reinterpret_cast<const char *>(&c), sizeof(c));
+        }
+    }
+
+private:
+    static const int shardCount = 16;
+    struct entry {
+        string key;
+        shared_ptr<const vector<float>> value;
+        size_t size;
+        uint64_t hash;
+    };
+    struct shard {
+        mutex lock;
+        list<entry> order;
+        unordered_map<uint64_t, list<entry>::iterator> index;
+        size_t bytes = 0;
+    };
+    shard shards[shardCount];
+    atomic<size_t> limit;
+
+    static uint64_t hash(const string &key){
+        uint64_t h = 0x9e3779b97f4a7c15ull ^ key.size();
+        size_t i = 0;
+        for(; i + 8 <= key.size(); i += 8){
+            uint64_t w;
+            memcpy(&w, key.data() + i, 8);
+            h = (h ^ w) * 0xff51afd7ed558ccdull;
+            h ^= h >> 32;
+        }
+        uint64_t w = 0;
+        memcpy(&w, key.data() + i, key.size() - i);
+        h = (h ^ w) * 0xc4ceb9fe1a85ec53ull;
+        return h ^ (h >> 29);
+    }
+};
+
+// cache shared by the memoized operations
+polyCache &polyMemo(){
+    static polyCache cache;
+    return cache;
+}
+
+vector<float> polyMultCached(vector<float> poly1, vector<float> poly2){
+    poly1 = polyCache::canonical(poly1);
+    poly2 = polyCache::canonical(poly2);
+    string key = "m";
+    polyCache::append(key, poly1);
+    polyCache::append(key, poly2);
+    return * polyMemo().get(key, [&]{ return polyMult(poly1, poly2); });
+}
+vector<float> polyPowCached(vector<float> poly, int power){
+    poly = polyCache::canonical(poly);
+    string key = "p" + to_string(power) + ":";
+    polyCache::append(key, poly);
+    return * polyMemo().get(key, [&]{ return polyPow(poly, power); });
+}
+vector<float> polyIntegCached(vector<float> poly){
+    poly = polyCache::canonical(poly);
+    string key = "i";
+    polyCache::append(key, poly);
+    return * polyMemo().get(key, [&]{ return polyInteg(poly); });
+}
+// keyed on the exact text, since polyParse reads spacing around signs
+vector<float> polyParseCached(string text){
+    return * polyMemo().get("t" + text, [&]{ return polyParse(text); });
+}
+
+// deferred polynomial expressions
+// Chains like polyDeriv(polyMult(polyAdd(a, b), c)) build a full vector
+// at every step. polyExpr records the operations as a graph instead,
+// sharing identical subexpressions, and only does the work when a
+// result is asked for. Before running it rewrites the graph: derivatives
+// move through sums and cancel integrals, constants fold, and chains of
+// sums and differences collapse into one pass over one output. When only
+// a value is wanted the graph is evaluated at the point directly, with
+// derivatives carried along as Taylor coefficients, so products and
+// powers are never expanded.
+enum polyKind {POLY_LEAF, POLY_ADD, POLY_SUB, POLY_MULT, POLY_POW, POLY_DERIV, POLY_INTEG};
+
+struct polyNode {
+    int kind, a, b, n;
+};
+
+class polyExpr {
+public:
+    // graph building, every call returns the id of a node
+    int leaf(vector<float> poly){
+        if(poly.empty()){
+            poly.push_back(0);
+        }
+        auto found = leafIds.find(poly);
+        if(found != leafIds.end()){
+            return found->second;
+        }
+        int id = node(POLY_LEAF, -1, -1, static_cast<int>(leaves.size()));
+        leaves.push_back(poly);
+        leafIds[poly] = id;
+        return id;
+    }
+    int add(int a, int b){
+        return node(POLY_ADD, a, b, 0);
+    }
+    int sub(int a, int b){
+        return node(POLY_SUB, a, b, 0);
+    }
+    int mult(int a, int b){
+        return node(POLY_MULT, a, b, 0);
+    }
+    int power(int a, int n){
+        return node(POLY_POW, a, -1, n);
+    }
+    int deriv(int a){
+        return node(POLY_DERIV, a, -1, 0);
+    }
+    int integ(int a){
+        return node(POLY_INTEG, a, -1, 0);
+    }
+
+    // coefficients of a node
+    vector<float> run(int root){
+        map<int, vector<float>> done;
+        return build(simplify(root), done);
+    }
+
+    // value of a node at x
+    float at(int root, float x){
+        map<pair<int, int>, vector<double>> done;
+        return static_cast<float>(jet(simplify(root), x, 0, done)[0]);
+    }
+
+    // definite integral of a node from a to b
+    float eval(int root, float a, float b){
+        vector<float> anti = run(integ(root));
+        double fa = 0, fb = 0;
+        for(int i = static_cast<int>(anti.size()) - 1; i >= 0; i--){
+            fa = fa * a + anti[i];
+            fb = fb * b + anti[i];
+        }
+        return static_cast<float>(fb - fa);
+    }
+
+    // rewritten equivalent of a node
+    int simplify(int root){
+        map<int, int> done;
+        return rewrite(root, done);
+    }
+
+    // number of distinct nodes recorded
+    int size(){
+        return static_cast<int>(nodes.size());
+    }
+
+private:
+    vector<polyNode> nodes;
+    vector<vector<float>> leaves;
+    map<vector<float>, int> leafIds;
+    map<array<int, 4>, int> opIds;
+
+    // hash consed node, so identical subexpressions share an id
+    int node(int kind, int a, int b, int n){
+        array<int, 4> key = {kind, a, b, n};
+        if(kind != POLY_LEAF){
+            auto found = opIds.find(key);
+            if(found != opIds.end()){
+                return found->second;
+            }
+        }
+        nodes.push_back(polyNode {kind, a, b, n});
+        int id = static_cast<int>(nodes.size()) - 1;
+        if(kind != POLY_LEAF){
+            opIds[key] = id;
+        }
+        return id;
+    }
+
+    // coefficients of a leaf, or null
+    vector<float> * constant(int i){
+        return nodes[i].kind == POLY_LEAF ? &leaves[nodes[i].n] : nullptr;
+    }
+    static bool zero(vector<float> * p){
+        if(!p){
+            return false;
+        }
+        for(float c : * p){
+            if(c){
+                return false;
+            }
+        }
+        return true;
+    }
+    static bool one(vector<float> * p){
+        return p && p->size() == 1 && (* p)[0] == 1;
+    }
+
+    int rewrite(int i, map<int, int> &done){
+        auto found = done.find(i);
+        if(found != done.end()){
+            return found->second;
+        }
+        polyNode n = nodes[i];
+        int r = i;
+        if(n.kind != POLY_LEAF){
+            int a = rewrite(n.a, done), b = n.b < 0 ? -1 : rewrite(n.b, done);
+            vector<float> * ca = constant(a), * cb = b < 0 ? nullptr : constant(b);
+            switch(n.kind){
+                case POLY_ADD:
+                case POLY_SUB:
+                    if(ca && cb){
+                        r = leaf(combine(* ca, * cb, n.kind == POLY_ADD ? 1 : -1));
+                    }
+                    else if(zero(cb)){
+                        r = a;
+                    }
+                    else if(zero(ca) && n.kind == POLY_ADD){
+                        r = b;
+                    }
+                    else if(a == b && n.kind == POLY_SUB){
+                        r = leaf({0});
+                    }
+                    else{
+                        r = node(n.kind, a, b, 0);
+                    }
+                break;
+                case POLY_MULT:
+                    if(zero(ca) || zero(cb)){
+                        r = leaf({0});
+                    }
+                    else if(one(ca)){
+                        r = b;
+                    }
+                    else if(one(cb)){
+                        r = a;
+                    }
+                    else if(ca && cb && (ca->size() == 1 || cb->size() == 1)){
+                        r = leaf(polyMult(* ca, * cb));
+                    }
+                    else{
+                        r = node(POLY_MULT, a, b, 0);
+                    }
+                break;
+                case POLY_POW:
+                    if(n.n == 0){
+                        r = leaf({1});
+                    }
+                    else if(n.n == 1){
+                        r = a;
+                    }
+                    else{
+                        r = node(POLY_POW, a, -1, n.n);
+                    }
+                break;
+                case POLY_DERIV:
+                    r = derivOf(a, done);
+                break;
+                case POLY_INTEG:
+                    if(ca){
+                        r = leaf(polyInteg(* ca));
+                    }
+                    else if(nodes[a].kind == POLY_DERIV){
+                        // integ(deriv(f)) = f - f(0)
+                        int f = nodes[a].a;
+                        map<pair<int, int>, vector<double>> values;
+                        r = rewrite(sub(f, leaf({static_cast<float>(jet(f, 0, 0, values)[0])})), done);
+                    }
+                    else{
+                        r = node(POLY_INTEG, a, -1, 0);
+                    }
+                break;
+            }
+        }
+        done[i] = r;
+        return r;
+    }
+
+    // derivative of an already rewritten node, pushed through sums
+    int derivOf(int a, map<int, int> &done){
+        polyNode n = nodes[a];
+        switch(n.kind){
+            case POLY_LEAF:{
+                vector<float> d = leaves[n.n].size() > 1 ? polyDeriv(leaves[n.n]) : vector<float> {0};
+                return leaf(d);
+            }
+            case POLY_ADD:
+            case POLY_SUB:
+                return rewrite(node(n.kind, derivOf(n.a, done), derivOf(n.b, done), 0), done);
+            case POLY_INTEG:
+                return n.a;
+            default:
+                return node(POLY_DERIV, a, -1, 0);
+        }
+    }
+
+    // a + sign * b
+    static vector<float> combine(vector<float> &a, vector<float> &b, int sign){
+        vector<float> c(max(a.size(), b.size()), 0);
+        for(size_t i = 0; i < a.size(); i++){
+            c[i] = a[i];
+        }
+        for(size_t i = 0; i < b.size(); i++){
+            c[i] += sign * b[i];
+        }
+        return c;
+    }
+
+    // collects the terms of a chain of sums and differences
+    void terms(int i, int sign, vector<pair<int, int>> &out){
+        polyNode n = nodes[i];
+        if(n.kind == POLY_ADD || n.kind == POLY_SUB){
+            terms(n.a, sign, out);
+            terms(n.b, n.kind == POLY_ADD ? sign : -sign, out);
+        }
+        else{
+            out.push_back({i, sign});
+        }
+    }
+
+    vector<float> build(int i, map<int, vector<float>> &done){
+        auto found = done.find(i);
+        if(found != done.end()){
+            return found->second;
+        }
+        polyNode n = nodes[i];
+        vector<float> r;
+        switch(n.kind){
+            case POLY_LEAF:
+                return leaves[n.n];
+            case POLY_ADD:
+            case POLY_SUB:{
+                // the whole chain accumulates into one vector
+                vector<pair<int, int>> parts;
+                terms(i, 1, parts);
+                for(auto &t : parts){
+                    vector<float> p = build(t.first, done);
+                    if(r.size() < p.size()){
+                        r.resize(p.size(), 0);
+                    }
+                    for(size_t j = 0; j < p.size(); j++){
+                        r[j] += t.second * p[j];
+                    }
+                }
+            }
+            break;
+            case POLY_MULT:
+                r = polyMult(build(n.a, done), build(n.b, done));
+            break;
+            case POLY_POW:{
+                vector<float> base = build(n.a, done);
+                r = {1};
+                for(int e = n.n; e > 0; e >>= 1){
+                    if(e & 1){
+                        r = polyMult(r, base);
+                    }
+                    if(e > 1){
+                        base = polyMult(base, base);
+                    }
+                }
+            }
+            break;
+            case POLY_DERIV:{
+                vector<float> a = build(n.a, done);
+                r = a.size() > 1 ? polyDeriv(a) : vector<float> {0};
+            }
+            break;
+            case POLY_INTEG:
+                r = polyInteg(build(n.a, done));
+            break;
+        }
+        done[i] = r;
+        return r;
+    }
+
+    // Taylor coefficients f(x), f'(x), f''(x) / 2 ... up to order k
+    vector<double> jet(int i, double x, int k, map<pair<int, int>, vector<double>> &done){
+        auto found = done.find({i, k});
+        if(found != done.end()){
+            return found->second;
+        }
+        polyNode n = nodes[i];
+        vector<double> t(k + 1, 0);
+        switch(n.kind){
+            case POLY_LEAF:
+            case POLY_INTEG:{
+                // repeated synthetic division by (X - x)
+                vector<float> p = n.kind == POLY_LEAF ? leaves[n.n] : run(i);
+                vector<double> c(p.begin(), p.end());
+                for(int j = 0; j <= k && !c.empty(); j++){
+                    double q = 0;
+                    for(int m = static_cast<int>(c.size()) - 1; m >= 0; m--){
+                        double next = q * x + c[m];
+                        c[m] = q;
+                        q = next;
+                    }
+                    t[j] = q;
+                    c.pop_back();
+                }
+            }
+            break;
+            case POLY_ADD:
+            case POLY_SUB:{
+                vector<double> a = jet(n.a, x, k, done), b = jet(n.b, x, k, done);
+                for(int j = 0; j <= k; j++){
+                    t[j] = n.kind == POLY_ADD ? a[j] + b[j] : a[j] - b[j];
+                }
+            }
+            break;
+            case POLY_MULT:
+                t = truncMult(jet(n.a, x, k, done), jet(n.b, x, k, done));
+            break;
+            case POLY_POW:{
+                vector<double> base = jet(n.a, x, k, done);
+                t[0] = 1;
+                for(int e = n.n; e > 0; e >>= 1){
+                    if(e & 1){
+                        t = truncMult(t, base);
+                    }
+                    if(e > 1){
+                        base = truncMult(base, base);
+                    }
+                }
+            }
+            break;
+            case POLY_DERIV:{
+                vector<double> a = jet(n.a, x, k + 1, done);
+                for(int j = 0; j <= k; j++){
+                    t[j] = (j + 1) * a[j + 1];
+                }
+            }
+            break;
+        }
+        done[{i, k}] = t;
+        return t;
+    }
+
+    // product of two Taylor series cut at the shorter order
+    static vector<double> truncMult(vector<double> a, vector<double> b){
+        vector<double> c(a.size(), 0);
+        for(size_t i = 0; i < a.size(); i++){
+            for(size_t j = 0; i + j < a.size(); j++){
+                c[i + j] += a[i] * b[j];
+            }
+        }
+        return c;
+    }
+};
+
 // scene help
 void polyTest(vector<float> &pol1, vector<float> &pol2, string &pol1txt, string &pol2txt){
     if(pol1.size() == 0 && pol2.size() == 0){
@@ -665,6 +2165,12 @@ int main(){
             break;
         };
     } while(scene != 11);
+#ifdef VECLIB_TRACE
+    // allocation summary, and stacks for a flame graph
+    traceReport(cerr);
+    ofstream flame("polynomials.folded");
+    traceFlame(flame);
+#endif
     cout << "\n\nprogram terminated\n\n\n";
     return 0;
 }
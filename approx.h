@@ -0,0 +1,324 @@
+//
+//  approx.h
+//  VecLib
+//
+// Polynomial approximations fitted to order. An approximation takes a
+// function, a range and an error bound, and splits the range into
+// equal pieces with one Chebyshev interpolant each, raising the degree
+// and then the number of pieces until the bound holds on a dense check
+// grid. Chebyshev interpolants sit within a small factor of the minimax
+// polynomial of the same degree, so the degree found is close to the
+// best possible. The table is stored as power coefficients in the
+// local coordinate of each piece, so evaluation is a table lookup and
+// one Horner loop, done a batch of lanes at a time, and can be written
+// out as standalone C++ source. The range reduced kernels below build
+// sin, cos and the inverse square root for any argument from fits over
+// one small interval.
+//
+
+#ifndef approx_h
+#define approx_h
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <functional>
+#include "math.h"
+
+#define APPROX_MAX_DEGREE 16
+#define APPROX_LANES 8
+
+// piecewise polynomial fit of f over [lo, hi]
+class approximation {
+public:
+    // fits f to within err, absolute or relative to |f|, using at most
+    // maxDegree per piece and maxPieces pieces; error() tells the bound
+    // that was actually reached when that is not enough
+    approximation(std::function<double(double)> f = [](double){ return 0.0; }, double a = 0, double b = 1, double err = 1e-12, bool relative = false, int maxDegree = APPROX_MAX_DEGREE, int maxPieces = 1 << 12) {
+        lo = a;
+        hi = b;
+        maxDegree = std::max(0, std::min(maxDegree, APPROX_MAX_DEGREE));
+        for(count = 1;; count *= 2){
+            for(deg = 0; deg <= maxDegree; deg++){
+                fit(f);
+                worst = check(f, relative);
+                if(worst <= err)
+                    return;
+            }
+            if(count * 2 > maxPieces){
+                deg = maxDegree;
+                fit(f);
+                worst = check(f, relative);
+                return;
+            }
+        }
+    }
+
+    // largest error seen on the check grid
+    double error() const {
+        return worst;
+    }
+
+    // pieces and the degree of each
+    int pieces() const {
+        return count;
+    }
+    int degree() const {
+        return deg;
+    }
+
+    // value at x, pieces at the ends extended past the range
+    double operator()(double x) const {
+        double u = (x - lo) * scale;
+        int i = std::max(0, std::min(count - 1, static_cast<int>(std::floor(u))));
+        double t = 2 * (u - i) - 1;
+        const double * c = table.data() + i * (deg + 1);
+        double y = c[deg];
+        for(int k = deg - 1; k >= 0; k--)
+            y = y * t + c[k];
+        return y;
+    }
+
+    // y[i] = value at x[i], for i < n
+    void eval(const double * x, double * y, int n) const {
+        int lane[APPROX_LANES];
+        double t[APPROX_LANES], v[APPROX_LANES];
+        const double * c = table.data();
+        double top = count - 1;
+        for(int b = 0; b < n; b += APPROX_LANES){
+            int m = std::min(APPROX_LANES, n - b);
+            for(int j = 0; j < APPROX_LANES; j++){
+                double u = ((j < m ? x[b + j] : lo) - lo) * scale;
+                double i = std::min(top, std::max(0.0, std::floor(u)));
+                lane[j] = static_cast<int>(i) * (deg + 1);
+                t[j] = 2 * (u - i) - 1;
+            }
+            if(count == 1){
+                // one piece, every lane shares the coefficients
+                for(int j = 0; j < APPROX_LANES; j++)
+                    v[j] = c[deg];
+                for(int k = deg - 1; k >= 0; k--)
+                    for(int j = 0; j < APPROX_LANES; j++)
+                        v[j] = v[j] * t[j] + c[k];
+            }
+            else{
+                for(int j = 0; j < APPROX_LANES; j++)
+                    v[j] = c[lane[j] + deg];
+                for(int k = deg - 1; k >= 0; k--)
+                    for(int j = 0; j < APPROX_LANES; j++)
+                        v[j] = v[j] * t[j] + c[lane[j] + k];
+            }
+            for(int j = 0; j < m; j++)
+                y[b + j] = v[j];
+        }
+    }
+
+    // writes the table and a scalar evaluator as C++ source
+    void emit(std::ostream & out, const std::string & name) const {
+        char buf[64];
+        out << "// " << name << " over [" << lo << ", " << hi << "], " << count << " pieces of degree " << deg << ", error " << worst << "\n";
+        out << "static const double " << name << "Table[" << table.size() << "] = {\n";
+        for(int i = 0; i < count; i++){
+            out << "   ";
+            for(int k = 0; k <= deg; k++){
+                std::snprintf(buf, sizeof(buf), " %.17g,", table[i * (deg + 1) + k]);
+                out << buf;
+            }
+            out << "\n";
+        }
+        out << "};\n";
+        out << "double " << name << "(double x){\n";
+        std::snprintf(buf, sizeof(buf), "%.17g", lo);
+        out << "    double u = (x - " << buf;
+        std::snprintf(buf, sizeof(buf), "%.17g", scale);
+        out << ") * " << buf << ";\n";
+        out << "    int i = u < 0 ? 0 : u >= " << count << " ? " << count - 1 << " : static_cast<int>(u);\n";
+        out << "    double t = 2 * (u - i) - 1;\n";
+        out << "    const double * c = " << name << "Table + i * " << deg + 1 << ";\n";
+        out << "    double y = c[" << deg << "];\n";
+        out << "    for(int k = " << deg - 1 << "; k >= 0; k--)\n";
+        out << "        y = y * t + c[k];\n";
+        out << "    return y;\n";
+        out << "}\n";
+    }
+
+private:
+    double lo, hi, scale, worst;
+    int count, deg;
+    std::vector<double> table;
+
+    // chebyshev interpolant of every piece, as powers of t in [-1, 1]
+    void fit(std::function<double(double)> & f) {
+        int n = deg + 1;
+        scale = count / (hi - lo);
+        table.assign(count * n, 0);
+        std::vector<double> node(n), value(n), cheb(n), tk(n), tk1(n), tk2(n);
+        for(int k = 0; k < n; k++)
+            node[k] = std::cos(M_PI * (k + 0.5) / n);
+        for(int i = 0; i < count; i++){
+            double a = lo + (hi - lo) * i / count, b = lo + (hi - lo) * (i + 1) / count;
+            for(int k = 0; k < n; k++)
+                value[k] = f(a + (b - a) * (node[k] + 1) / 2);
+            for(int j = 0; j < n; j++){
+                double s = 0;
+                for(int k = 0; k < n; k++)
+                    s += value[k] * std::cos(M_PI * j * (k + 0.5) / n);
+                cheb[j] = s * 2 / n;
+            }
+            cheb[0] /= 2;
+
+            // T_j as powers of t by T_j = 2t T_j-1 - T_j-2
+            double * c = table.data() + i * n;
+            std::fill(tk2.begin(), tk2.end(), 0.0);
+            std::fill(tk1.begin(), tk1.end(), 0.0);
+            tk2[0] = 1;
+            c[0] += cheb[0];
+            if(n > 1){
+                tk1[1] = 1;
+                c[1] += cheb[1];
+            }
+            for(int j = 2; j < n; j++){
+                for(int k = 0; k < n; k++)
+                    tk[k] = (k ? 2 * tk1[k - 1] : 0) - tk2[k];
+                for(int k = 0; k < n; k++)
+                    c[k] += cheb[j] * tk[k];
+                std::swap(tk2, tk1);
+                std::swap(tk1, tk);
+            }
+        }
+    }
+
+    // largest error over a grid of every piece; relative checks skip
+    // the zeros of f, where no relative bound can hold
+    double check(std::function<double(double)> & f, bool relative) const {
+        int grid = 32 * (deg + 2);
+        double e = 0;
+        for(int i = 0; i < count; i++){
+            for(int k = 0; k <= grid; k++){
+                double x = lo + (hi - lo) * (i + static_cast<double>(k) / grid) / count, y = f(x);
+                double d = std::abs((*this)(x) - y);
+                if(relative){
+                    if(y == 0)
+                        continue;
+                    d /= std::abs(y);
+                }
+                if(!(d <= e))
+                    e = d;
+            }
+        }
+        return e;
+    }
+};
+
+// sines and cosines from fits over [-pi/4, pi/4] and the quadrant,
+// with the same reduction as sinCos
+class approxSinCos {
+public:
+    approxSinCos(double err = 1e-7, int maxDegree = APPROX_MAX_DEGREE)
+        : sine([](double x){ return std::sin(x); }, -M_PI / 4, M_PI / 4, err, false, maxDegree),
+          cosine([](double x){ return std::cos(x); }, -M_PI / 4, M_PI / 4, err, false, maxDegree) {}
+
+    // the fits themselves
+    const approximation & sin() const {
+        return sine;
+    }
+    const approximation & cos() const {
+        return cosine;
+    }
+
+    // s[i], c[i] = sin and cos of t[i], for i < n; angles past 1e6 use libm
+    void eval(const double * t, double * s, double * c, int n) const {
+        double r[APPROX_LANES], a[APPROX_LANES], b[APPROX_LANES];
+        long q[APPROX_LANES];
+        for(int i = 0; i < n; i += APPROX_LANES){
+            int m = std::min(APPROX_LANES, n - i);
+            for(int j = 0; j < m; j++){
+                double x = t[i + j], k = std::nearbyint(x * sinCosInvHalfPi);
+                k = std::abs(x) <= 1e6 ? k : 0.0;
+                r[j] = x - k * sinCosHalfPi[0] - k * sinCosHalfPi[1] - k * sinCosHalfPi[2];
+                q[j] = static_cast<long>(k);
+            }
+            sine.eval(r, a, m);
+            cosine.eval(r, b, m);
+            for(int j = 0; j < m; j++){
+                double u = q[j] & 1 ? b[j] : a[j], v = q[j] & 1 ? a[j] : b[j];
+                s[i + j] = q[j] & 2 ? -u : u;
+                c[i + j] = (q[j] + 1) & 2 ? -v : v;
+            }
+        }
+        for(int i = 0; i < n; i++){
+            if(!(std::abs(t[i]) <= 1e6)){
+                s[i] = std::sin(t[i]);
+                c[i] = std::cos(t[i]);
+            }
+        }
+    }
+
+private:
+    approximation sine, cosine;
+};
+
+// 1 / sqrt(x) for positive normal x from a relative fit over [1, 4):
+// x = m 4^e with m in [1, 4) gives 1 / sqrt(x) = 2^-e / sqrt(m), with
+// both steps done on the exponent bits
+class approxInvSqrt {
+public:
+    approxInvSqrt(double err = 1e-7, int maxDegree = APPROX_MAX_DEGREE)
+        : fit([](double x){ return 1 / std::sqrt(x); }, 1, 4, err, true, maxDegree) {}
+
+    // the fit itself
+    const approximation & reduced() const {
+        return fit;
+    }
+
+    // y[i] = 1 / sqrt(x[i]), for i < n
+    void eval(const double * x, double * y, int n) const {
+        double m[APPROX_LANES];
+        int64_t e[APPROX_LANES];
+        for(int i = 0; i < n; i += APPROX_LANES){
+            int k = std::min(APPROX_LANES, n - i);
+            for(int j = 0; j < k; j++){
+                int64_t bits;
+                std::memcpy(&bits, x + i + j, 8);
+                // exponent halved, the odd bit left in the mantissa
+                e[j] = ((bits >> 52) - 1023) >> 1;
+                bits -= e[j] * 2 * (static_cast<int64_t>(1) << 52);
+                std::memcpy(m + j, &bits, 8);
+            }
+            fit.eval(m, y + i, k);
+            for(int j = 0; j < k; j++){
+                int64_t bits;
+                std::memcpy(&bits, y + i + j, 8);
+                bits -= e[j] * (static_cast<int64_t>(1) << 52);
+                std::memcpy(y + i + j, &bits, 8);
+            }
+        }
+    }
+    double operator()(double x) const {
+        double y;
+        eval(&x, &y, 1);
+        return y;
+    }
+
+    // magnitudes of n vectors as |v|^2 / |v|
+    void norms(const vec3 * v, double * out, int n) const {
+        for(int i = 0; i < n; i++)
+            out[i] = v[i].x * v[i].x + v[i].y * v[i].y + v[i].z * v[i].z;
+        double y[APPROX_LANES];
+        for(int i = 0; i < n; i += APPROX_LANES){
+            int k = std::min(APPROX_LANES, n - i);
+            eval(out + i, y, k);
+            for(int j = 0; j < k; j++)
+                out[i + j] = out[i + j] > 0 ? out[i + j] * y[j] : 0;
+        }
+    }
+
+private:
+    approximation fit;
+};
+
+#endif /* approx_h */
@@ -0,0 +1,333 @@
+//
+//  batch.h
+//  VecLib
+//
+// Determinants, inverses and linear solves for large batches of 2 x 2,
+// 3 x 3 and 4 x 4 matrices. A batch is stored by entry: one array per
+// matrix entry holding that entry of every matrix, so lane i of each
+// array is matrix i. The kernels are closed form adjugates with no
+// pivoting and no branches, and every lane runs the same instructions
+// on unit stride loads, so the loops vectorize across matrices. Right
+// hand sides and solutions are laid out the same way, one array of n
+// per component.
+//
+// Each lane gets a flag. The adjugate is taken of the matrix with every
+// row divided by its largest entry, so the flag test does not overflow
+// or underflow with the scale of the entries, and the row scales are put
+// back into the results afterwards. A lane is singular when its
+// determinant is zero or not finite, or tiny next to the product of its
+// row lengths, and ill conditioned when that ratio is small but not
+// tiny; singular lanes get zeros instead of their inverse or solution.
+//
+
+#ifndef batch_h
+#define batch_h
+
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "math.h"
+#include "parallel.h"
+
+// lanes worked on at a time, and matrices per thread before a batch is
+// split
+#define BATCH_BLOCK 64
+#define BATCH_PARALLEL (1 << 13)
+
+// |det| / (product of row lengths) below which a lane is flagged; the
+// ratio is 1 for orthogonal matrices and 0 for singular ones
+#define BATCH_SINGULAR_RATIO 1e-14
+#define BATCH_ILL_RATIO 1e-8
+
+// lane flags
+enum batchFlag {BATCH_OK, BATCH_ILL, BATCH_SINGULAR};
+
+class matrixBatch {
+public:
+    // n matrices of d x d, d from 2 to 4, all identity
+    matrixBatch(int d = 3, int n = 0) {
+        dims = d < 2 ? 2 : (d > 4 ? 4 : d);
+        resize(n);
+    }
+
+    // new count, added matrices set to identity
+    void resize(int n) {
+        int old = count;
+        count = n;
+        std::vector<double> e(static_cast<size_t>(dims) * dims * n);
+        for(int k = 0; k < dims * dims; k++){
+            double one = k % (dims + 1) == 0;
+            for(int i = 0; i < n; i++)
+                e[static_cast<size_t>(k) * n + i] = i < old ? entries[static_cast<size_t>(k) * old + i] : one;
+        }
+        entries.swap(e);
+    }
+
+    int dim() const {
+        return dims;
+    }
+    int size() const {
+        return count;
+    }
+
+    // entry (r, c) of every matrix
+    double * entry(int r, int c) {
+        return entries.data() + static_cast<size_t>(r * dims + c) * count;
+    }
+    const double * entry(int r, int c) const {
+        return entries.data() + static_cast<size_t>(r * dims + c) * count;
+    }
+
+    // matrix i to and from the fixed size types, which must match dim()
+    void set(int i, mat2 m) {
+        vec2 r[2] = {m.x, m.y};
+        for(int j = 0; j < 2; j++){
+            entry(j, 0)[i] = r[j].x;
+            entry(j, 1)[i] = r[j].y;
+        }
+    }
+    void set(int i, mat3 m) {
+        vec3 r[3] = {m.x, m.y, m.z};
+        for(int j = 0; j < 3; j++){
+            entry(j, 0)[i] = r[j].x;
+            entry(j, 1)[i] = r[j].y;
+            entry(j, 2)[i] = r[j].z;
+        }
+    }
+    void set(int i, mat4 m) {
+        vec4 r[4] = {m.x, m.y, m.z, m.w};
+        for(int j = 0; j < 4; j++){
+            entry(j, 0)[i] = r[j].x;
+            entry(j, 1)[i] = r[j].y;
+            entry(j, 2)[i] = r[j].z;
+            entry(j, 3)[i] = r[j].w;
+        }
+    }
+    void get(int i, mat2 & m) const {
+        m = mat2(vec2(entry(0, 0)[i], entry(0, 1)[i]), vec2(entry(1, 0)[i], entry(1, 1)[i]));
+    }
+    void get(int i, mat3 & m) const {
+        vec3 r[3];
+        for(int j = 0; j < 3; j++)
+            r[j] = vec3(entry(j, 0)[i], entry(j, 1)[i], entry(j, 2)[i]);
+        m = mat3(r[0], r[1], r[2]);
+    }
+    void get(int i, mat4 & m) const {
+        vec4 r[4];
+        for(int j = 0; j < 4; j++)
+            r[j] = vec4(entry(j, 0)[i], entry(j, 1)[i], entry(j, 2)[i], entry(j, 3)[i]);
+        m = mat4(r[0], r[1], r[2], r[3]);
+    }
+
+private:
+    int dims = 3, count = 0;
+    std::vector<double> entries;
+};
+
+// determinant of the D x D matrix v, entries row by row, with its
+// adjugate written to w
+template <int D>
+double batchAdjugate(const double (&v)[D * D], double (&w)[D * D]){
+    if constexpr(D == 2){
+        w[0] = v[3];
+        w[1] = -v[1];
+        w[2] = -v[2];
+        w[3] = v[0];
+        return v[0] * v[3] - v[1] * v[2];
+    }
+    else if constexpr(D == 3){
+        w[0] = v[4] * v[8] - v[5] * v[7];
+        w[1] = v[2] * v[7] - v[1] * v[8];
+        w[2] = v[1] * v[5] - v[2] * v[4];
+        w[3] = v[5] * v[6] - v[3] * v[8];
+        w[4] = v[0] * v[8] - v[2] * v[6];
+        w[5] = v[2] * v[3] - v[0] * v[5];
+        w[6] = v[3] * v[7] - v[4] * v[6];
+        w[7] = v[1] * v[6] - v[0] * v[7];
+        w[8] = v[0] * v[4] - v[1] * v[3];
+        return v[0] * w[0] + v[1] * w[3] + v[2] * w[6];
+    }
+    else{
+        // 2 x 2 minors of the top and bottom row pairs
+        double s0 = v[0] * v[5] - v[4] * v[1], s1 = v[0] * v[6] - v[4] * v[2], s2 = v[0] * v[7] - v[4] * v[3];
+        double s3 = v[1] * v[6] - v[5] * v[2], s4 = v[1] * v[7] - v[5] * v[3], s5 = v[2] * v[7] - v[6] * v[3];
+        double c5 = v[10] * v[15] - v[14] * v[11], c4 = v[9] * v[15] - v[13] * v[11], c3 = v[9] * v[14] - v[13] * v[10];
+        double c2 = v[8] * v[15] - v[12] * v[11], c1 = v[8] * v[14] - v[12] * v[10], c0 = v[8] * v[13] - v[12] * v[9];
+        w[0] = v[5] * c5 - v[6] * c4 + v[7] * c3;
+        w[1] = -v[1] * c5 + v[2] * c4 - v[3] * c3;
+        w[2] = v[13] * s5 - v[14] * s4 + v[15] * s3;
+        w[3] = -v[9] * s5 + v[10] * s4 - v[11] * s3;
+        w[4] = -v[4] * c5 + v[6] * c2 - v[7] * c1;
+        w[5] = v[0] * c5 - v[2] * c2 + v[3] * c1;
+        w[6] = -v[12] * s5 + v[14] * s2 - v[15] * s1;
+        w[7] = v[8] * s5 - v[10] * s2 + v[11] * s1;
+        w[8] = v[4] * c4 - v[5] * c2 + v[7] * c0;
+        w[9] = -v[0] * c4 + v[1] * c2 - v[3] * c0;
+        w[10] = v[12] * s4 - v[13] * s2 + v[15] * s0;
+        w[11] = -v[8] * s4 + v[9] * s2 - v[11] * s0;
+        w[12] = -v[4] * c3 + v[5] * c1 - v[6] * c0;
+        w[13] = v[0] * c3 - v[1] * c1 + v[2] * c0;
+        w[14] = -v[12] * s3 + v[13] * s1 - v[14] * s0;
+        w[15] = v[8] * s3 - v[9] * s1 + v[10] * s0;
+        return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    }
+}
+
+// lanes [i, i + n) of a, n <= BATCH_BLOCK, copied into e: determinants,
+// adjugates, the factor each adjugate is scaled by (0 when singular) and
+// the flags. Each lane is loaded into registers and worked on with no
+// calls or branches, so the loop over lanes vectorizes
+template <int D>
+void batchBlock(const double * const * a, int i, int n, double (&e)[D * D][BATCH_BLOCK], double (&adj)[D * D][BATCH_BLOCK], double * __restrict det, double * __restrict scale, double * __restrict flag){
+    for(int k = 0; k < D * D; k++)
+        std::copy(a[k] + i, a[k] + i + n, e[k]);
+    for(int j = 0; j < n; j++){
+        double v[D * D], w[D * D], s[D], h = 1, g = 1;
+        for(int k = 0; k < D * D; k++)
+            v[k] = e[k][j];
+        // rows scaled by their largest entry, which leaves their squared
+        // lengths between 1 and D whatever the scale of the matrix; zero
+        // rows stay zero. Divides are made safe on every lane rather than
+        // skipped, so the loop has no branches
+        for(int r = 0; r < D; r++){
+            double m = 0, l = 0;
+            for(int k = 0; k < D; k++)
+                m = std::max(m, std::abs(v[r * D + k]));
+            double nonzero = m > 0 ? 1.0 : 0.0;
+            s[r] = nonzero / (m + (1 - nonzero));
+            for(int k = 0; k < D; k++){
+                v[r * D + k] *= s[r];
+                l += v[r * D + k] * v[r * D + k];
+            }
+            h *= m;
+            g *= l;
+        }
+        // the inverse of the scaled rows times the scales, by column
+        double d = batchAdjugate<D>(v, w);
+        for(int k = 0; k < D * D; k++)
+            adj[k][j] = w[k] * s[k % D];
+        // squared ratio, at most 1; NaN compares false, so lanes that are
+        // not finite come out singular. The flags are kept as doubles
+        double q = d * d / (g + (g > 0 ? 0.0 : 1.0));
+        double singular = q >= BATCH_SINGULAR_RATIO * BATCH_SINGULAR_RATIO ? 0.0 : 1.0;
+        double ill = q >= BATCH_ILL_RATIO * BATCH_ILL_RATIO ? 0.0 : 1.0;
+        flag[j] = singular + ill;
+        scale[j] = (1 - singular) / (d + singular * (1 + std::abs(d)));
+        det[j] = d * h;
+    }
+}
+
+// entry arrays of a batch, row by row
+template <int D>
+void batchEntries(const matrixBatch & a, const double ** e){
+    for(int r = 0; r < D; r++)
+        for(int c = 0; c < D; c++)
+            e[r * D + c] = a.entry(r, c);
+}
+
+// runs f(i, n, adj, det, scale, flag) on each block of lanes, blocks
+// spread over the thread pool
+template <int D, typename F>
+void batchRun(const matrixBatch & a, F f){
+    const double * e[D * D];
+    batchEntries<D>(a, e);
+    parallelFor(a.size(), BATCH_PARALLEL, [&](int b, int end){
+        double m[D * D][BATCH_BLOCK], adj[D * D][BATCH_BLOCK], det[BATCH_BLOCK], scale[BATCH_BLOCK];
+        double flag[BATCH_BLOCK];
+        for(int i = b; i < end; i += BATCH_BLOCK){
+            int n = std::min(BATCH_BLOCK, end - i);
+            batchBlock<D>(e, i, n, m, adj, det, scale, flag);
+            f(i, n, adj, det, scale, flag);
+        }
+    });
+}
+
+template <int D>
+void batchDet(const matrixBatch & a, double * det, uint8_t * flags){
+    batchRun<D>(a, [&](int i, int n, double (&)[D * D][BATCH_BLOCK], const double * d, const double *, const double * flag){
+        std::copy(d, d + n, det + i);
+        if(flags)
+            for(int j = 0; j < n; j++)
+                flags[i + j] = static_cast<uint8_t>(flag[j]);
+    });
+}
+
+template <int D>
+void batchInverse(const matrixBatch & a, matrixBatch & inv, uint8_t * flags){
+    double * o[D * D];
+    for(int k = 0; k < D * D; k++)
+        o[k] = inv.entry(k / D, k % D);
+    batchRun<D>(a, [&](int i, int n, double (&adj)[D * D][BATCH_BLOCK], const double *, const double * scale, const double * flag){
+        for(int k = 0; k < D * D; k++){
+            double * out = o[k] + i;
+            for(int j = 0; j < n; j++)
+                out[j] = flag[j] < BATCH_SINGULAR ? adj[k][j] * scale[j] : 0.0;
+        }
+        if(flags)
+            for(int j = 0; j < n; j++)
+                flags[i + j] = static_cast<uint8_t>(flag[j]);
+    });
+}
+
+template <int D>
+void batchSolve(const matrixBatch & a, const double * rhs, double * x, uint8_t * flags){
+    size_t n = a.size();
+    batchRun<D>(a, [&](int i, int m, double (&adj)[D * D][BATCH_BLOCK], const double *, const double * scale, const double * flag){
+        double v[D][BATCH_BLOCK];
+        for(int c = 0; c < D; c++)
+            std::copy(rhs + c * n + i, rhs + c * n + i + m, v[c]);
+        for(int r = 0; r < D; r++){
+            double t[BATCH_BLOCK] = {};
+            for(int c = 0; c < D; c++)
+                for(int j = 0; j < m; j++)
+                    t[j] += adj[r * D + c][j] * v[c][j];
+            double * out = x + r * n + i;
+            for(int j = 0; j < m; j++)
+                out[j] = flag[j] < BATCH_SINGULAR ? t[j] * scale[j] : 0.0;
+        }
+        if(flags)
+            for(int j = 0; j < m; j++)
+                flags[i + j] = static_cast<uint8_t>(flag[j]);
+    });
+}
+
+// determinants of every matrix, flags optional
+void determinants(const matrixBatch & a, double * det, uint8_t * flags = nullptr){
+    PROFILE_SCOPE("determinants", 0, 0);
+    if(a.dim() == 2)
+        batchDet<2>(a, det, flags);
+    else if(a.dim() == 3)
+        batchDet<3>(a, det, flags);
+    else
+        batchDet<4>(a, det, flags);
+}
+
+// inverses of every matrix into inv, resized to match
+void inverses(const matrixBatch & a, matrixBatch & inv, uint8_t * flags = nullptr){
+    PROFILE_SCOPE("inverses", 0, 0);
+    if(inv.dim() != a.dim())
+        inv = matrixBatch(a.dim(), a.size());
+    else
+        inv.resize(a.size());
+    if(a.dim() == 2)
+        batchInverse<2>(a, inv, flags);
+    else if(a.dim() == 3)
+        batchInverse<3>(a, inv, flags);
+    else
+        batchInverse<4>(a, inv, flags);
+}
+
+// x with a x = b for every matrix; b and x hold dim() arrays of size()
+// values, component c of lane i at c * size() + i
+void solve(const matrixBatch & a, const double * b, double * x, uint8_t * flags = nullptr){
+    PROFILE_SCOPE("solve", 0, 0);
+    if(a.dim() == 2)
+        batchSolve<2>(a, b, x, flags);
+    else if(a.dim() == 3)
+        batchSolve<3>(a, b, x, flags);
+    else
+        batchSolve<4>(a, b, x, flags);
+}
+
+#endif /* batch_h */
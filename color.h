@@ -0,0 +1,144 @@
+//
+//  color.h
+//  VecLib
+//
+// Batch conversion between vec4 colors (r, g, b, a in x, y, z, w, from
+// 0 to 1) and packed 32 bit pixels. Each pixel is clamped, scaled,
+// rounded and shifted into its word in one branch free pass that the
+// compiler vectorizes, so a frame converts at memory speed. sRGB encoding
+// goes through a table over the linear range plus one compare, which
+// lands on the exactly rounded byte, and decoding through a 256 entry
+// table.
+//
+
+#ifndef color_h
+#define color_h
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "math.h"
+
+// vec3 colors converted at a time, and sRGB encode table steps
+#define COLOR_BLOCK 256
+#define COLOR_TABLE 4096
+
+// word layouts, ARGB being the one color() makes
+enum pixelFormat {PIXEL_ARGB, PIXEL_RGBA};
+
+// sRGB transfer curves
+double srgbEncode(double l){
+    return l <= 0.0031308 ? 12.92 * l : 1.055 * std::pow(l, 1 / 2.4) - 0.055;
+}
+double srgbDecode(double s){
+    return s <= 0.04045 ? s / 12.92 : std::pow((s + 0.055) / 1.055, 2.4);
+}
+
+// lookup tables, built on first use. encode holds the byte at the low
+// end of each of COLOR_TABLE steps of the linear range; the curve rises
+// by less than one byte per step, so one compare against the midpoint
+// of the next byte, in rise, gives the exactly rounded byte
+struct srgbTables {
+    uint8_t encode[COLOR_TABLE + 1];
+    double rise[256], decode[256];
+
+    srgbTables(){
+        for(int i = 0; i <= COLOR_TABLE; i++)
+            encode[i] = static_cast<uint8_t>(std::lround(srgbEncode(static_cast<double>(i) / COLOR_TABLE) * 255));
+        for(int i = 0; i < 256; i++){
+            decode[i] = srgbDecode(i / 255.0);
+            rise[i] = i < 255 ? srgbDecode((i + 0.5) / 255) : 2;
+        }
+    }
+};
+const srgbTables & srgb(){
+    static srgbTables t;
+    return t;
+}
+
+// a channel clamped to [0, 1] and rounded to a byte, NaN going to 0
+template <typename T>
+uint32_t colorByte(T v){
+    v = v > 0 ? (v < 1 ? v : T(1)) : T(0);
+    return static_cast<uint32_t>(v * 255 + T(0.5));
+}
+template <typename T>
+uint32_t colorByte(T v, const srgbTables & t){
+    v = v > 0 ? (v < 1 ? v : T(1)) : T(0);
+    uint32_t b = t.encode[static_cast<int>(v * COLOR_TABLE)];
+    return b + (v >= t.rise[b]);
+}
+
+// packs n colors, given as 4 channels each, in one pass of clamps,
+// scales and shifts that vectorizes; sRGB leaves alpha linear
+template <typename T>
+void packChannels(const T * c, uint32_t * out, int n, int format, bool encode){
+    int r = 16, g = 8, b = 0, a = 24;
+    if(format == PIXEL_RGBA){
+        r = 24;
+        g = 16;
+        b = 8;
+        a = 0;
+    }
+    if(encode){
+        const srgbTables & t = srgb();
+        for(int i = 0; i < n; i++){
+            const T * p = c + 4 * static_cast<size_t>(i);
+            out[i] = colorByte(p[0], t) << r | colorByte(p[1], t) << g | colorByte(p[2], t) << b | colorByte(p[3]) << a;
+        }
+        return;
+    }
+    for(int i = 0; i < n; i++){
+        const T * p = c + 4 * static_cast<size_t>(i);
+        out[i] = colorByte(p[0]) << r | colorByte(p[1]) << g | colorByte(p[2]) << b | colorByte(p[3]) << a;
+    }
+}
+
+// packs n colors into words
+void pack(const vec4 * c, uint32_t * out, int n, int format = PIXEL_ARGB, bool encode = false){
+    packChannels(&c[0].x, out, n, format, encode);
+}
+void pack(const float * rgba, uint32_t * out, int n, int format = PIXEL_ARGB, bool encode = false){
+    packChannels(rgba, out, n, format, encode);
+}
+void pack(const vec3 * c, uint32_t * out, int n, int format = PIXEL_ARGB, bool encode = false, double alpha = 1){
+    double t[4 * COLOR_BLOCK];
+    for(int i = 0; i < n; i += COLOR_BLOCK){
+        int m = std::min(COLOR_BLOCK, n - i);
+        for(int j = 0; j < m; j++){
+            t[4 * j] = c[i + j].x;
+            t[4 * j + 1] = c[i + j].y;
+            t[4 * j + 2] = c[i + j].z;
+            t[4 * j + 3] = alpha;
+        }
+        packChannels(t, out + i, m, format, encode);
+    }
+}
+
+// unpacks n words into colors, 4 channels each
+template <typename T>
+void unpackChannels(const uint32_t * p, T * c, int n, int format, bool decode){
+    // shift of r, g, b and a in the word
+    int s[4] = {24, 16, 8, 0};
+    if(format == PIXEL_ARGB){
+        s[0] = 16;
+        s[1] = 8;
+        s[2] = 0;
+        s[3] = 24;
+    }
+    const double * table = srgb().decode;
+    for(int i = 0; i < n; i++){
+        for(int k = 0; k < 4; k++){
+            int v = p[i] >> s[k] & 0xff;
+            c[4 * static_cast<size_t>(i) + k] = static_cast<T>(decode && k < 3 ? table[v] : v * (1 / 255.0));
+        }
+    }
+}
+void unpack(const uint32_t * p, vec4 * c, int n, int format = PIXEL_ARGB, bool decode = false){
+    unpackChannels(p, &c[0].x, n, format, decode);
+}
+void unpack(const uint32_t * p, float * rgba, int n, int format = PIXEL_ARGB, bool decode = false){
+    unpackChannels(p, rgba, n, format, decode);
+}
+
+#endif /* color_h */
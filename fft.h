@@ -0,0 +1,362 @@
+//
+//  fft.h
+//  VecLib
+//
+// Fast fourier transforms over contiguous arrays of complex numbers.
+// A plan is built once per length and holds every twiddle factor the
+// transform needs, so repeated transforms do no trig at all. Powers
+// of two run fully in place as radix-4 passes (with one radix-2 pass
+// for odd powers) after a bit reversal; any other length is split
+// into radix 4, 2, 3, 5 and leftover prime stages and runs as a
+// Stockham autosort through a scratch buffer owned by the plan.
+// Leftover primes up to FFT_BLUESTEIN use a direct p point DFT; larger
+// ones use Bluestein's chirp convolution on a power of two plan, so
+// every length costs O(n log n). Lengths below 2 are the identity.
+// The real transform packs even lengths into a complex one of half the
+// length and runs odd ones at full length. Transforms work in buffers
+// owned by the plan, so one plan serves one thread at a time.
+//
+
+#ifndef fft_h
+#define fft_h
+
+#include <cmath>
+#include <vector>
+#include <iostream>
+#include "math.h"
+
+#define FFT_BLUESTEIN 64
+
+// complex transform plan
+class fftPlan {
+public:
+    fftPlan(int n = 1) {
+        length = std::max(n, 0);
+        pow2 = n > 1 && !(n & (n - 1));
+        if(length <= 1)
+            return;
+        if(pow2){
+            // tw[h + j] = W_2h ^ j for every half size h
+            tw.assign(n, complex(1.0, 0.0));
+            for(int h = 1; h < n; h <<= 1)
+                for(int j = 0; j < h; j++)
+                    tw[h + j] = polar(1.0, -M_PI * j / h);
+            rev.assign(n, 0);
+            for(int i = 1, b = 0; i < n; i++){
+                int bit = n >> 1;
+                for(; b & bit; bit >>= 1)
+                    b ^= bit;
+                b ^= bit;
+                rev[i] = b;
+            }
+            return;
+        }
+
+        // radix 4, 2, 3 and 5 first, then whatever primes are left
+        int m = n;
+        for(int p : {4, 2, 3, 5}){
+            while(m % p == 0){
+                radix.push_back(p);
+                m /= p;
+            }
+        }
+        for(int p = 7; m > 1; p += 2){
+            while(m % p == 0){
+                radix.push_back(p);
+                m /= p;
+            }
+        }
+
+        // per stage, W_L ^ (t * u) for t < L / p and 0 < u < p,
+        // followed by W_p ^ k for the butterfly itself
+        int L = n;
+        for(int st = 0; st < static_cast<int>(radix.size()); st++){
+            int p = radix[st];
+            offset.push_back(static_cast<int>(tw.size()));
+            for(int k = 0; k < p; k++)
+                tw.push_back(polar(1.0, -2.0 * M_PI * k / p));
+            int s = L / p;
+            for(int t = 0; t < s; t++)
+                for(int u = 1; u < p; u++)
+                    tw.push_back(polar(1.0, -2.0 * M_PI * (static_cast<long>(t) * u % L) / L));
+            L = s;
+            chirpOf.push_back(-1);
+            if(p > FFT_BLUESTEIN)
+                chirpOf[st] = st && radix[st - 1] == p ? chirpOf[st - 1] : bluesteinSetup(p);
+            if(static_cast<int>(column.size()) < 2 * p)
+                column.resize(2 * p);
+        }
+        scratch.assign(n, complex(0.0, 0.0));
+    }
+
+    // transform length
+    int len() {
+        return length;
+    }
+
+    // forward transform in place, unscaled
+    void forward(complex * x){
+        if(pow2)
+            radix4(x);
+        else
+            stockham(x);
+    }
+
+    // inverse transform in place, scaled by 1 / n
+    void inverse(complex * x){
+        double s = 1.0 / length;
+        for(int i = 0; i < length; i++)
+            x[i].i = -x[i].i;
+        forward(x);
+        for(int i = 0; i < length; i++){
+            x[i].r *= s;
+            x[i].i *= -s;
+        }
+    }
+
+private:
+    int length;
+    bool pow2;
+    std::vector<complex> tw, scratch;
+    std::vector<int> rev, radix, offset;
+
+    // the p inputs of one butterfly and p more for its own scratch
+    std::vector<complex> column;
+
+    // per stage, the bluestein data it uses or -1: the chirp W_2p ^ k^2
+    // for k < p, the transform of its conjugate and the plan for that
+    std::vector<int> chirpOf;
+    std::vector<std::vector<complex>> chirp, chirpHat;
+    std::vector<fftPlan> chirpPlan;
+    std::vector<complex> work;
+
+    // builds the bluestein data for prime p and returns its index
+    int bluesteinSetup(int p){
+        int M = 1;
+        while(M < 2 * p - 1)
+            M <<= 1;
+        std::vector<complex> w(p), b(M, complex(0.0, 0.0));
+        for(int k = 0; k < p; k++)
+            w[k] = polar(1.0, -M_PI * (static_cast<long>(k) * k % (2 * p)) / p);
+        b[0] = w[0].conj();
+        for(int k = 1; k < p; k++){
+            b[k] = w[k].conj();
+            b[M - k] = b[k];
+        }
+        chirpPlan.push_back(fftPlan(M));
+        chirpPlan.back().forward(b.data());
+        chirp.push_back(w);
+        chirpHat.push_back(b);
+        if(static_cast<int>(work.size()) < M)
+            work.resize(M);
+        return static_cast<int>(chirp.size()) - 1;
+    }
+
+    // p point dft in place as a convolution with chirp j
+    void bluestein(complex * a, int p, int j){
+        fftPlan & plan = chirpPlan[j];
+        const complex * w = chirp[j].data(), * b = chirpHat[j].data();
+        int M = plan.len();
+        complex * z = work.data();
+        for(int k = 0; k < p; k++)
+            z[k] = a[k] * w[k];
+        for(int k = p; k < M; k++)
+            z[k] = complex(0.0, 0.0);
+        plan.forward(z);
+        for(int k = 0; k < M; k++)
+            z[k] = z[k] * b[k];
+        plan.inverse(z);
+        for(int u = 0; u < p; u++)
+            a[u] = z[u] * w[u];
+    }
+
+    // in place decimation in time, two radix-2 stages per pass
+    void radix4(complex * x){
+        int n = length;
+        for(int i = 0; i < n; i++){
+            if(i < rev[i]){
+                complex t = x[i];
+                x[i] = x[rev[i]];
+                x[rev[i]] = t;
+            }
+        }
+        int m = 1;
+        if(__builtin_ctz(n) & 1){
+            for(int k = 0; k < n; k += 2){
+                complex a = x[k], b = x[k + 1];
+                x[k] = a + b;
+                x[k + 1] = a - b;
+            }
+            m = 2;
+        }
+        for(; m < n; m <<= 2){
+            for(int k = 0; k < n; k += 4 * m){
+                for(int j = 0; j < m; j++){
+                    complex * a = x + k + j;
+                    complex w1 = tw[m + j], w2 = tw[2 * m + j];
+                    complex t1 = w1 * a[m], t3 = w1 * a[3 * m];
+                    complex b0 = a[0] + t1, b1 = a[0] - t1, b2 = a[2 * m] + t3, b3 = a[2 * m] - t3;
+                    complex u = w2 * b2, v = w2 * b3;
+                    v = complex(v.i, -v.r);
+                    a[0] = b0 + u;
+                    a[2 * m] = b0 - u;
+                    a[m] = b1 + v;
+                    a[3 * m] = b1 - v;
+                }
+            }
+        }
+    }
+
+    // mixed radix decimation in frequency, ping-ponging with scratch
+    void stockham(complex * data){
+        complex * x = data, * y = scratch.data(), * in = column.data();
+        int L = length, s = 1;
+        for(int st = 0; st < static_cast<int>(radix.size()); st++){
+            int p = radix[st], m = L / p;
+            complex * root = tw.data() + offset[st], * w = root + p;
+            for(int t = 0; t < m; t++){
+                complex * wt = w + t * (p - 1);
+                for(int q = 0; q < s; q++){
+                    for(int r = 0; r < p; r++)
+                        in[r] = x[q + s * (t + r * m)];
+                    complex * out = y + q + s * p * t;
+                    butterfly(in, in + p, p, root, chirpOf[st]);
+                    out[0] = in[0];
+                    for(int u = 1; u < p; u++)
+                        out[s * u] = in[u] * wt[u - 1];
+                }
+            }
+            complex * t = x;
+            x = y;
+            y = t;
+            s *= p;
+            L = m;
+        }
+        if(x != data)
+            for(int i = 0; i < length; i++)
+                data[i] = x[i];
+    }
+
+    // p point dft in place, c is scratch for p values, root holds
+    // W_p ^ k and j is the bluestein data for large primes or -1
+    void butterfly(complex * a, complex * c, int p, complex * root, int j){
+        if(p == 2){
+            complex t = a[0];
+            a[0] = t + a[1];
+            a[1] = t - a[1];
+        }
+        else if(p == 4){
+            complex s0 = a[0] + a[2], d0 = a[0] - a[2], s1 = a[1] + a[3], d1 = a[1] - a[3];
+            d1 = complex(d1.i, -d1.r);
+            a[0] = s0 + s1;
+            a[1] = d0 + d1;
+            a[2] = s0 - s1;
+            a[3] = d0 - d1;
+        }
+        else if(j >= 0)
+            bluestein(a, p, j);
+        else{
+            for(int u = 0; u < p; u++){
+                complex sum = a[0];
+                for(int r = 1, k = u; r < p; r++, k = k + u < p ? k + u : k + u - p)
+                    sum += a[r] * root[k];
+                c[u] = sum;
+            }
+            for(int u = 0; u < p; u++)
+                a[u] = c[u];
+        }
+    }
+};
+
+// real input transform plan, runs a complex plan of half the length
+// over the samples packed in pairs for even lengths, and one of the
+// full length through a buffer for odd ones
+class rfftPlan {
+public:
+    rfftPlan(int n = 2) : plan(n % 2 ? n : n / 2) {
+        length = std::max(n, 0);
+        half = length / 2;
+        if(length % 2){
+            buffer.resize(length);
+            return;
+        }
+        w.resize(half / 2 + 1);
+        for(int k = 0; k <= half / 2; k++)
+            w[k] = polar(1.0, -2.0 * M_PI * k / n);
+    }
+
+    // transform length
+    int len() {
+        return length;
+    }
+
+    // n real samples to the n / 2 + 1 non-redundant bins
+    void forward(const double * x, complex * X){
+        if(length % 2){
+            for(int k = 0; k < length; k++)
+                buffer[k] = complex(x[k], 0.0);
+            plan.forward(buffer.data());
+            for(int k = 0; k <= half; k++)
+                X[k] = buffer[k];
+            return;
+        }
+        if(!length){
+            X[0] = complex(0.0, 0.0);
+            return;
+        }
+        for(int k = 0; k < half; k++)
+            X[k] = complex(x[2 * k], x[2 * k + 1]);
+        plan.forward(X);
+        complex z = X[0];
+        X[0] = complex(z.r + z.i, 0.0);
+        X[half] = complex(z.r - z.i, 0.0);
+        for(int k = 1; k <= half / 2; k++){
+            complex a = X[k], b = X[half - k].conj();
+            complex e = (a + b) * 0.5, o = (a - b) * 0.5;
+            o = w[k] * complex(o.i, -o.r);
+            X[k] = e + o;
+            X[half - k] = (e - o).conj();
+        }
+    }
+
+    // n / 2 + 1 bins back to n real samples, scaled by 1 / n;
+    // X is used as the workspace and is overwritten
+    void inverse(complex * X, double * x){
+        if(length % 2){
+            buffer[0] = X[0];
+            for(int k = 1; k <= half; k++){
+                buffer[k] = X[k];
+                buffer[length - k] = X[k].conj();
+            }
+            plan.inverse(buffer.data());
+            for(int k = 0; k < length; k++)
+                x[k] = buffer[k].r;
+            return;
+        }
+        if(!length)
+            return;
+        complex a = X[0], b = X[half].conj();
+        complex e = (a + b) * 0.5, o = (a - b) * 0.5;
+        X[0] = e + complex(-o.i, o.r);
+        for(int k = 1; k <= half / 2; k++){
+            a = X[k];
+            b = X[half - k].conj();
+            e = (a + b) * 0.5;
+            o = (a - b) * w[k].conj() * 0.5;
+            X[k] = e + complex(-o.i, o.r);
+            X[half - k] = e.conj() + complex(o.i, o.r);
+        }
+        plan.inverse(X);
+        for(int k = 0; k < half; k++){
+            x[2 * k] = X[k].r;
+            x[2 * k + 1] = X[k].i;
+        }
+    }
+
+private:
+    int length, half;
+    fftPlan plan;
+    std::vector<complex> w, buffer;
+};
+
+#endif /* fft_h */
@@ -0,0 +1,256 @@
+//
+//  image.h
+//  VecLib
+//
+// Framebuffers and image files. A framebuffer keeps its pixels in
+// square tiles stored one after another, so a tile is one contiguous
+// block that a thread can fill without sharing cache lines with the
+// tiles around it; render() hands tiles out over the shared thread
+// pool. An imageWriter saves frames as binary PPM or PFM on its own
+// thread. It holds two frame buffers: write() copies a frame into the
+// free one and returns while the writer thread converts and saves the
+// other, so the caller only waits when it gets two frames ahead of
+// the disk.
+//
+
+#ifndef image_h
+#define image_h
+
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <condition_variable>
+#include "math.h"
+#include "color.h"
+#include "parallel.h"
+
+// tile edge in pixels
+#define IMAGE_TILE 32
+
+// file formats, 8 bit RGB and 32 bit float RGB
+enum imageFormat {IMAGE_PPM, IMAGE_PFM};
+
+class framebuffer {
+public:
+    framebuffer(int w = 0, int h = 0) {
+        resize(w, h);
+    }
+
+    // new size, contents cleared to black
+    void resize(int w, int h) {
+        wide = std::max(0, w);
+        high = std::max(0, h);
+        across = (wide + IMAGE_TILE - 1) / IMAGE_TILE;
+        down = (high + IMAGE_TILE - 1) / IMAGE_TILE;
+        pixels.assign(static_cast<size_t>(across) * down * IMAGE_TILE * IMAGE_TILE, vec4(0, 0, 0, 1));
+    }
+
+    int width() const {
+        return wide;
+    }
+    int height() const {
+        return high;
+    }
+    int tiles() const {
+        return across * down;
+    }
+
+    // pixel (x, y), y going down from the top row
+    vec4 & at(int x, int y) {
+        return pixels[index(x, y)];
+    }
+    const vec4 & at(int x, int y) const {
+        return pixels[index(x, y)];
+    }
+
+    // pixels of tile t, IMAGE_TILE rows of IMAGE_TILE, and the part of
+    // the image it covers as [x0, x1) by [y0, y1)
+    vec4 * tile(int t) {
+        return pixels.data() + static_cast<size_t>(t) * IMAGE_TILE * IMAGE_TILE;
+    }
+    void bounds(int t, int & x0, int & y0, int & x1, int & y1) const {
+        x0 = t % across * IMAGE_TILE;
+        y0 = t / across * IMAGE_TILE;
+        x1 = std::min(wide, x0 + IMAGE_TILE);
+        y1 = std::min(high, y0 + IMAGE_TILE);
+    }
+
+    // sets every pixel to f(x, y), tiles spread over the thread pool
+    template <typename F>
+    void render(F f) {
+        parallelFor(tiles(), 1, [&](int b, int e){
+            for(int t = b; t < e; t++){
+                int x0, y0, x1, y1;
+                bounds(t, x0, y0, x1, y1);
+                vec4 * p = tile(t);
+                for(int y = y0; y < y1; y++)
+                    for(int x = x0; x < x1; x++)
+                        p[(y - y0) * IMAGE_TILE + x - x0] = f(x, y);
+            }
+        });
+    }
+
+    // every pixel set to c
+    void clear(vec4 c) {
+        for(vec4 & p : pixels)
+            p = c;
+    }
+
+    // copies row y into out, width() pixels
+    void row(int y, vec4 * out) const {
+        const vec4 * p = pixels.data() + (static_cast<size_t>(y / IMAGE_TILE) * across * IMAGE_TILE + y % IMAGE_TILE) * IMAGE_TILE;
+        for(int x = 0; x < wide; x += IMAGE_TILE){
+            int n = std::min(IMAGE_TILE, wide - x);
+            std::copy(p, p + n, out + x);
+            p += IMAGE_TILE * IMAGE_TILE;
+        }
+    }
+
+private:
+    int wide = 0, high = 0, across = 0, down = 0;
+    std::vector<vec4> pixels;
+
+    size_t index(int x, int y) const {
+        size_t t = static_cast<size_t>(y / IMAGE_TILE) * across + x / IMAGE_TILE;
+        return t * IMAGE_TILE * IMAGE_TILE + (y % IMAGE_TILE) * IMAGE_TILE + x % IMAGE_TILE;
+    }
+};
+
+// writes a framebuffer as binary PPM, sRGB encoded unless linear, or as
+// little endian PFM; false if the file could not be written
+bool saveImage(const framebuffer & f, const std::string & path, int format = IMAGE_PPM, bool linear = false) {
+    std::FILE * out = std::fopen(path.c_str(), "wb");
+    if(!out)
+        return false;
+    int w = f.width(), h = f.height();
+    std::vector<vec4> line(w);
+    bool ok;
+    if(format == IMAGE_PFM){
+        ok = std::fprintf(out, "PF\n%d %d\n-1.0\n", w, h) > 0;
+        std::vector<float> rgb(3 * static_cast<size_t>(w));
+        // rows bottom to top
+        for(int y = h - 1; ok && y >= 0; y--){
+            f.row(y, line.data());
+            for(int x = 0; x < w; x++){
+                rgb[3 * x] = static_cast<float>(line[x].x);
+                rgb[3 * x + 1] = static_cast<float>(line[x].y);
+                rgb[3 * x + 2] = static_cast<float>(line[x].z);
+            }
+            ok = std::fwrite(rgb.data(), sizeof(float), rgb.size(), out) == rgb.size();
+        }
+    }
+    else{
+        ok = std::fprintf(out, "P6\n%d %d\n255\n", w, h) > 0;
+        std::vector<uint32_t> word(w);
+        std::vector<uint8_t> rgb(3 * static_cast<size_t>(w));
+        for(int y = 0; ok && y < h; y++){
+            f.row(y, line.data());
+            pack(line.data(), word.data(), w, PIXEL_ARGB, !linear);
+            for(int x = 0; x < w; x++){
+                rgb[3 * x] = word[x] >> 16 & 0xff;
+                rgb[3 * x + 1] = word[x] >> 8 & 0xff;
+                rgb[3 * x + 2] = word[x] & 0xff;
+            }
+            ok = std::fwrite(rgb.data(), 1, rgb.size(), out) == rgb.size();
+        }
+    }
+    return std::fclose(out) == 0 && ok;
+}
+
+// saves frames on a background thread, two frames in flight
+class imageWriter {
+public:
+    imageWriter() {
+        worker = std::thread([this]{ work(); });
+    }
+    imageWriter(const imageWriter &) = delete;
+    ~imageWriter() {
+        flush();
+        {
+            std::lock_guard<std::mutex> l(lock);
+            stop = true;
+        }
+        wake.notify_all();
+        worker.join();
+    }
+
+    // queues a copy of f to be saved to path, waiting only while both
+    // buffers are still being saved; safe to call from several threads,
+    // frames from different threads are saved in the order their copies
+    // finish
+    void write(const framebuffer & f, const std::string & path, int format = IMAGE_PPM, bool linear = false) {
+        std::unique_lock<std::mutex> l(lock);
+        done.wait(l, [&]{ return !slot[next].full && !slot[next].busy; });
+        frame & s = slot[next];
+        // claimed under the lock, so another writer gets the other slot
+        s.busy = true;
+        next ^= 1;
+        l.unlock();
+        s.image = f;
+        s.path = path;
+        s.format = format;
+        s.linear = linear;
+        l.lock();
+        s.busy = false;
+        s.full = true;
+        s.order = queued++;
+        wake.notify_all();
+    }
+
+    // waits for every queued frame to be saved
+    void flush() {
+        std::unique_lock<std::mutex> l(lock);
+        done.wait(l, [&]{ return !slot[0].full && !slot[1].full && !slot[0].busy && !slot[1].busy; });
+    }
+
+    // frames saved so far, and how many of them failed
+    int saved() {
+        std::lock_guard<std::mutex> l(lock);
+        return count;
+    }
+    int failed() {
+        std::lock_guard<std::mutex> l(lock);
+        return errors;
+    }
+
+private:
+    struct frame {
+        framebuffer image;
+        std::string path;
+        int format = IMAGE_PPM;
+        bool linear = false, full = false, busy = false;
+        unsigned order = 0;
+    };
+    frame slot[2];
+    int next = 0, count = 0, errors = 0;
+    unsigned queued = 0, taken = 0;
+    bool stop = false;
+    std::mutex lock;
+    std::condition_variable wake, done;
+    std::thread worker;
+
+    // saves full slots in the order they were queued
+    void work() {
+        for(;;){
+            std::unique_lock<std::mutex> l(lock);
+            wake.wait(l, [&]{ return stop || queued != taken; });
+            if(queued == taken)
+                return;
+            frame & s = slot[0].full && slot[0].order == taken ? slot[0] : slot[1];
+            l.unlock();
+            bool ok = saveImage(s.image, s.path, s.format, s.linear);
+            l.lock();
+            taken++;
+            count++;
+            errors += !ok;
+            s.full = false;
+            done.notify_all();
+        }
+    }
+};
+
+#endif /* image_h */
@@ -0,0 +1,434 @@
+//
+//  ingest.h
+//  VecLib
+//
+// Loading (key, vec4) records from disk. A record file is mapped into
+// memory and read a window at a time; each window is cut into one piece
+// per thread at line boundaries and the pieces are parsed in parallel
+// straight from the mapping, with no string made per line. Keys are
+// hashed in place and numbered per piece, then matched up with the
+// caller's table once per distinct key. Rows reach the callback in file
+// order, one window at a time, and finished windows are handed back to
+// the kernel so a file of any size streams through a fixed footprint.
+//
+// Text files hold one record per line as key,x,y,z,w; lines that do not
+// parse, like headers and blank lines, are skipped and counted. Binary
+// files are columnar: the magic "VLR1", the key count and each key as a
+// length and its bytes, the row count, then the key column as int32 and
+// the x, y, z and w columns as doubles, all little endian.
+//
+
+#ifndef ingest_h
+#define ingest_h
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "math.h"
+#include "tally.h"
+#include "parallel.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+// bytes of text parsed per window, and binary rows per window
+#define INGEST_WINDOW (64 << 20)
+#define INGEST_ROWS (1 << 20)
+
+// read only view of a whole file, mapped where possible
+class mappedFile {
+public:
+    mappedFile(const std::string & path) {
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if(fd < 0)
+            return;
+        if(fstat(fd, &st) == 0 && st.st_size > 0){
+            void * p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if(p != MAP_FAILED){
+                base = static_cast<const char *>(p);
+                length = static_cast<size_t>(st.st_size);
+                mapped = good = true;
+                madvise(p, length, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);
+        if(mapped)
+            return;
+#endif
+        std::ifstream in(path, std::ios::binary);
+        if(!in)
+            return;
+        copy.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        base = copy.data();
+        length = copy.size();
+        good = true;
+    }
+    mappedFile(const mappedFile &) = delete;
+    ~mappedFile() {
+#if defined(__unix__) || defined(__APPLE__)
+        if(mapped)
+            munmap(const_cast<char *>(base), length);
+#endif
+    }
+
+    bool open() const {
+        return good;
+    }
+    const char * data() const {
+        return base;
+    }
+    size_t size() const {
+        return length;
+    }
+
+    // done with [b, e), its pages can be dropped
+    void release(size_t b, size_t e) {
+#if defined(__unix__) || defined(__APPLE__)
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        b = (b + page - 1) / page * page;
+        e = e / page * page;
+        if(mapped && b < e)
+            madvise(const_cast<char *>(base) + b, e - b, MADV_DONTNEED);
+#endif
+    }
+
+private:
+    const char * base = nullptr;
+    size_t length = 0;
+    bool mapped = false, good = false;
+    std::vector<char> copy;
+};
+
+// one thread's share of a window: rows with keys numbered locally
+struct ingestPiece {
+    std::vector<int> key;
+    std::vector<double> x, y, z, w;
+    std::vector<const char *> name;
+    std::vector<int> nameLength;
+    std::vector<int> slot;
+    std::vector<uint64_t> hash;
+    size_t skipped = 0;
+
+    void clear() {
+        key.clear();
+        x.clear();
+        y.clear();
+        z.clear();
+        w.clear();
+        name.clear();
+        nameLength.clear();
+        slot.assign(64, -1);
+        hash.clear();
+        skipped = 0;
+    }
+
+    // local number of the key in [s, s + n), by open addressing
+    int id(const char * s, int n) {
+        uint64_t h = 1469598103934665603ull;
+        for(int i = 0; i < n; i++)
+            h = (h ^ static_cast<unsigned char>(s[i])) * 1099511628211ull;
+        size_t mask = slot.size() - 1;
+        for(size_t i = h & mask;; i = (i + 1) & mask){
+            int k = slot[i];
+            if(k < 0){
+                slot[i] = static_cast<int>(name.size());
+                name.push_back(s);
+                nameLength.push_back(n);
+                hash.push_back(h);
+                if(name.size() * 2 > slot.size())
+                    grow();
+                return static_cast<int>(name.size()) - 1;
+            }
+            if(hash[k] == h && nameLength[k] == n && std::memcmp(name[k], s, n) == 0)
+                return k;
+        }
+    }
+
+private:
+    void grow() {
+        slot.assign(slot.size() * 2, -1);
+        size_t mask = slot.size() - 1;
+        for(size_t k = 0; k < name.size(); k++){
+            size_t i = hash[k] & mask;
+            while(slot[i] >= 0)
+                i = (i + 1) & mask;
+            slot[i] = static_cast<int>(k);
+        }
+    }
+};
+
+// parses a decimal number from [p, e), moving p past it; false when
+// there is none. Up to 19 digits with a power of ten in double range
+// are done exactly as an integer and one scaling, which rounds
+// correctly for up to 15 digits and exponents within 22; anything
+// longer goes through strtod on a small copy
+bool ingestNumber(const char * & p, const char * e, double & v) {
+    static const double tens[23] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const char * s = p;
+    while(s < e && (*s == ' ' || *s == '\t'))
+        s++;
+    const char * start = s;
+    bool negative = false;
+    if(s < e && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+    uint64_t m = 0;
+    int digits = 0, scale = 0;
+    bool any = false;
+    for(; s < e && *s >= '0' && *s <= '9'; s++, any = true){
+        if(digits < 19){
+            m = m * 10 + (*s - '0');
+            digits += m > 0;
+        }
+        else
+            scale++;
+    }
+    if(s < e && *s == '.'){
+        for(s++; s < e && *s >= '0' && *s <= '9'; s++, any = true){
+            if(digits < 19){
+                m = m * 10 + (*s - '0');
+                digits += m > 0;
+                scale--;
+            }
+        }
+    }
+    if(!any)
+        return false;
+    if(s < e && (*s == 'e' || *s == 'E')){
+        const char * t = s + 1;
+        bool down = false;
+        if(t < e && (*t == '-' || *t == '+'))
+            down = *t++ == '-';
+        if(t < e && *t >= '0' && *t <= '9'){
+            int x = 0;
+            for(; t < e && *t >= '0' && *t <= '9'; t++)
+                x = x < 10000 ? x * 10 + (*t - '0') : x;
+            scale += down ? -x : x;
+            s = t;
+        }
+    }
+    if(digits <= 15 && scale >= -22 && scale <= 22)
+        v = scale < 0 ? m / tens[-scale] : m * tens[scale];
+    else{
+        char buf[64];
+        size_t n = std::min(static_cast<size_t>(s - start), sizeof(buf) - 1);
+        std::memcpy(buf, start, n);
+        buf[n] = 0;
+        v = std::strtod(buf, nullptr);
+        negative = false;
+    }
+    if(negative)
+        v = -v;
+    p = s;
+    return true;
+}
+
+// parses the lines in [b, e), which holds whole lines only
+void ingestLines(const char * b, const char * e, ingestPiece & out) {
+    while(b < e){
+        const char * end = static_cast<const char *>(std::memchr(b, '\n', e - b));
+        if(!end)
+            end = e;
+        // length as size_t so memchr sees a bound that cannot be negative
+        size_t n = static_cast<size_t>(end - b);
+        if(n && b[n - 1] == '\r')
+            n--;
+        const char * line = b + n;
+        const char * comma = static_cast<const char *>(std::memchr(b, ',', n));
+        double v[4];
+        bool ok = comma != nullptr;
+        const char * p = comma ? comma + 1 : line;
+        for(int d = 0; ok && d < 4; d++){
+            ok = ingestNumber(p, line, v[d]);
+            while(ok && p < line && (*p == ' ' || *p == '\t'))
+                p++;
+            if(ok && d < 3)
+                ok = p < line && *p++ == ',';
+        }
+        if(ok && p == line){
+            const char * k = b, * ke = comma;
+            while(k < ke && (*k == ' ' || *k == '\t'))
+                k++;
+            while(ke > k && (ke[-1] == ' ' || ke[-1] == '\t'))
+                ke--;
+            out.key.push_back(out.id(k, static_cast<int>(ke - k)));
+            out.x.push_back(v[0]);
+            out.y.push_back(v[1]);
+            out.z.push_back(v[2]);
+            out.w.push_back(v[3]);
+        }
+        else if(line > b)
+            out.skipped++;
+        b = end + 1;
+    }
+}
+
+// reads a text record file window by window, calling f(batch) with the
+// rows of each window in file order; batch is cleared before each
+// window and keeps its keys, so their numbers hold across windows.
+// returns the rows read, with the skipped lines in skipped
+template <typename F>
+size_t streamCsv(const std::string & path, records & batch, F f, size_t * skipped = nullptr) {
+    mappedFile file(path);
+    if(skipped)
+        *skipped = 0;
+    if(!file.open())
+        return 0;
+    const char * data = file.data();
+    size_t n = file.size(), rows = 0, at = 0;
+    std::vector<ingestPiece> pieces(threadCount());
+    std::vector<int> map;
+    while(at < n){
+        // window cut just past a newline
+        size_t end = std::min(n, at + INGEST_WINDOW);
+        if(end < n){
+            const char * nl = static_cast<const char *>(std::memchr(data + end, '\n', n - end));
+            end = nl ? nl - data + 1 : n;
+        }
+        int t = std::max(1, std::min(static_cast<int>(pieces.size()), static_cast<int>((end - at) >> 20)));
+        std::vector<size_t> cut(t + 1);
+        cut[0] = at;
+        cut[t] = end;
+        for(int c = 1; c < t; c++){
+            size_t s = std::max(cut[c - 1], at + (end - at) * c / t);
+            const char * nl = static_cast<const char *>(std::memchr(data + s, '\n', end - s));
+            cut[c] = nl ? nl - data + 1 : end;
+        }
+        sharedPool().run(t, [&](int c){
+            pieces[c].clear();
+            ingestLines(data + cut[c], data + cut[c + 1], pieces[c]);
+        });
+
+        // local key numbers to the batch's, then the rows in order
+        batch.clear();
+        for(int c = 0; c < t; c++){
+            ingestPiece & p = pieces[c];
+            map.resize(p.name.size());
+            for(size_t k = 0; k < p.name.size(); k++)
+                map[k] = batch.id(std::string(p.name[k], p.nameLength[k]));
+            for(int k : p.key)
+                batch.key.push_back(map[k]);
+            batch.x.insert(batch.x.end(), p.x.begin(), p.x.end());
+            batch.y.insert(batch.y.end(), p.y.begin(), p.y.end());
+            batch.z.insert(batch.z.end(), p.z.begin(), p.z.end());
+            batch.w.insert(batch.w.end(), p.w.begin(), p.w.end());
+            if(skipped)
+                *skipped += p.skipped;
+        }
+        rows += batch.size();
+        f(batch);
+        file.release(at, end);
+        at = end;
+    }
+    return rows;
+}
+
+// reads a binary record file INGEST_ROWS rows at a time, as streamCsv;
+// returns the rows read, stopping early on a malformed file
+template <typename F>
+size_t streamBinary(const std::string & path, records & batch, F f) {
+    mappedFile file(path);
+    if(!file.open() || file.size() < 8 || std::memcmp(file.data(), "VLR1", 4) != 0)
+        return 0;
+    const char * data = file.data();
+    size_t n = file.size(), at = 4;
+    auto read = [&](void * v, size_t s){
+        if(at + s > n)
+            return false;
+        std::memcpy(v, data + at, s);
+        at += s;
+        return true;
+    };
+    uint32_t keys, length;
+    uint64_t count;
+    if(!read(&keys, 4))
+        return 0;
+    std::vector<int> map(keys);
+    for(uint32_t k = 0; k < keys; k++){
+        if(!read(&length, 4) || at + length > n)
+            return 0;
+        map[k] = batch.id(std::string(data + at, length));
+        at += length;
+    }
+    if(!read(&count, 8) || (n - at) / 36 < count)
+        return 0;
+    const char * key = data + at, * col[4];
+    for(int d = 0; d < 4; d++)
+        col[d] = key + 4 * count + 8 * count * d;
+    for(uint64_t r = 0; r < count; r += INGEST_ROWS){
+        int m = static_cast<int>(std::min<uint64_t>(INGEST_ROWS, count - r));
+        batch.clear();
+        batch.key.resize(m);
+        batch.x.resize(m);
+        batch.y.resize(m);
+        batch.z.resize(m);
+        batch.w.resize(m);
+        double * dst[4] = {batch.x.data(), batch.y.data(), batch.z.data(), batch.w.data()};
+        std::atomic<bool> ok(true);
+        parallelFor(m, 1 << 16, [&](int b, int e){
+            for(int i = b; i < e; i++){
+                int32_t k;
+                std::memcpy(&k, key + 4 * (r + i), 4);
+                if(k < 0 || static_cast<uint32_t>(k) >= keys){
+                    ok = false;
+                    k = 0;
+                }
+                batch.key[i] = keys ? map[k] : 0;
+            }
+            for(int d = 0; d < 4; d++)
+                std::memcpy(dst[d] + b, col[d] + 8 * (r + b), 8 * static_cast<size_t>(e - b));
+        });
+        if(!ok || !keys)
+            return static_cast<size_t>(r);
+        f(batch);
+        file.release(key + 4 * r - data, key + 4 * (r + m) - data);
+        for(int d = 0; d < 4; d++)
+            file.release(col[d] + 8 * r - data, col[d] + 8 * (r + m) - data);
+    }
+    return static_cast<size_t>(count);
+}
+
+// whole files into one table
+size_t loadCsv(const std::string & path, records & out, size_t * skipped = nullptr) {
+    records batch;
+    return streamCsv(path, batch, [&](const records & b){ out.append(b); }, skipped);
+}
+size_t loadBinary(const std::string & path, records & out) {
+    records batch;
+    return streamBinary(path, batch, [&](const records & b){ out.append(b); });
+}
+
+// writes a table as a binary record file
+bool saveBinary(const std::string & path, const records & r) {
+    std::ofstream out(path, std::ios::binary);
+    if(!out)
+        return false;
+    uint32_t keys = r.keys();
+    uint64_t count = r.size();
+    out.write("VLR1", 4);
+    out.write(reinterpret_cast<const char *>(&keys), 4);
+    for(int k = 0; k < r.keys(); k++){
+        uint32_t length = static_cast<uint32_t>(r.name(k).size());
+        out.write(reinterpret_cast<const char *>(&length), 4);
+        out.write(r.name(k).data(), length);
+    }
+    out.write(reinterpret_cast<const char *>(&count), 8);
+    for(int i = 0; i < r.size(); i++){
+        int32_t k = r.key[i];
+        out.write(reinterpret_cast<const char *>(&k), 4);
+    }
+    for(const std::vector<double> * c : {&r.x, &r.y, &r.z, &r.w})
+        out.write(reinterpret_cast<const char *>(c->data()), 8 * static_cast<std::streamsize>(c->size()));
+    return static_cast<bool>(out);
+}
+
+#endif /* ingest_h */
@@ -0,0 +1,640 @@
+//
+//  linalg.h
+//  VecLib
+//
+// Dense factorizations of matrix<T>: LU with partial pivoting, Cholesky
+// and Householder QR, with solves, inverses, determinants and least
+// squares built on them. All three are blocked and right looking: a
+// panel of LINALG_BLOCK columns is factored, then the rest of the
+// matrix is updated by it in one matrix product. That product holds
+// nearly all of the work for large matrices; it runs along rows of the
+// row major storage, a band of columns at a time so the panel stays in
+// cache, and is split by rows over the shared thread pool. Triangular
+// solves against many right hand sides are split by columns.
+//
+// Factorizations are classes that take the matrix by value and factor
+// it in place, so a caller done with its matrix can move it in. Failure
+// is reported, not thrown: a zero pivot leaves an LU singular, a
+// matrix that is not positive definite stops a Cholesky, and solves on
+// them give infinities or NaNs.
+//
+
+#ifndef linalg_h
+#define linalg_h
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include "math.h"
+#include "parallel.h"
+
+// panel width, and columns of the trailing matrix updated per pass
+#define LINALG_BLOCK 64
+#define LINALG_COLUMNS 256
+
+// multiply adds per thread before an update is split
+#define LINALG_PARALLEL (1 << 18)
+
+// c -= a b for rows [r0, r1) of c, where a is m x k and b is k x n, each
+// with its own row stride and none overlapping; if lower, only the lower
+// triangle of c is needed, and rows are cut off at the diagonal of the
+// last row in their group of four
+template <typename T>
+void linalgRows(T * c, int ldc, const T * a, int lda, const T * b, int ldb, int r0, int r1, int n, int k, bool lower){
+    for(int j0 = 0; j0 < n; j0 += LINALG_COLUMNS){
+        int i = r0;
+        // four rows at a time share each load of b
+        for(; i + 4 <= r1; i += 4){
+            int j1 = std::min(n, j0 + LINALG_COLUMNS);
+            if(lower)
+                j1 = std::min(j1, i + 4);
+            T * __restrict c0 = c + static_cast<size_t>(i) * ldc;
+            T * __restrict c1 = c0 + ldc;
+            T * __restrict c2 = c1 + ldc;
+            T * __restrict c3 = c2 + ldc;
+            const T * ai = a + static_cast<size_t>(i) * lda;
+            for(int p = 0; p < k; p++){
+                T s0 = ai[p], s1 = ai[lda + p], s2 = ai[2 * lda + p], s3 = ai[3 * lda + p];
+                const T * __restrict bp = b + static_cast<size_t>(p) * ldb;
+                for(int j = j0; j < j1; j++){
+                    T v = bp[j];
+                    c0[j] -= s0 * v;
+                    c1[j] -= s1 * v;
+                    c2[j] -= s2 * v;
+                    c3[j] -= s3 * v;
+                }
+            }
+        }
+        for(; i < r1; i++){
+            int j1 = std::min(n, j0 + LINALG_COLUMNS);
+            if(lower)
+                j1 = std::min(j1, i + 1);
+            T * ci = c + static_cast<size_t>(i) * ldc;
+            const T * ai = a + static_cast<size_t>(i) * lda;
+            for(int p = 0; p < k; p++){
+                T s = ai[p];
+                const T * bp = b + static_cast<size_t>(p) * ldb;
+                for(int j = j0; j < j1; j++)
+                    ci[j] -= s * bp[j];
+            }
+        }
+    }
+}
+
+// c -= a b for an m x n block c, split over the thread pool in bands of
+// LINALG_BLOCK rows. For the lower triangle, band t is paired with band
+// count - 1 - t so every task gets the same share of the triangle
+template <typename T>
+void linalgUpdate(T * c, int ldc, const T * a, int lda, const T * b, int ldb, int m, int n, int k, bool lower = false){
+    if(m <= 0 || n <= 0 || k <= 0)
+        return;
+    int bands = (m + LINALG_BLOCK - 1) / LINALG_BLOCK;
+    int tasks = lower ? (bands + 1) / 2 : bands;
+    double work = static_cast<double>(m) * n * k / (lower ? 2 : 1);
+    int grain = std::max(1, static_cast<int>(tasks * (LINALG_PARALLEL / work)));
+    parallelFor(tasks, grain, [&](int b0, int e0){
+        for(int t = b0; t < e0; t++){
+            linalgRows(c, ldc, a, lda, b, ldb, t * LINALG_BLOCK, std::min(m, (t + 1) * LINALG_BLOCK), n, k, lower);
+            int u = bands - 1 - t;
+            if(lower && u != t)
+                linalgRows(c, ldc, a, lda, b, ldb, u * LINALG_BLOCK, std::min(m, (u + 1) * LINALG_BLOCK), n, k, lower);
+        }
+    });
+}
+
+// runs f(begin, end) over the k columns of a right hand side, split over
+// the thread pool once there are work multiply adds per column
+template <typename F>
+void linalgColumns(int k, double work, F f){
+    parallelFor(k, std::max(1, static_cast<int>(LINALG_PARALLEL / std::max(1.0, work))), f);
+}
+
+// solves l x = b in place for columns [c0, c1) of the n x k right hand
+// side b, l lower triangular, with ones on the diagonal if unit
+template <typename T>
+void linalgForward(const T * l, int ldl, int n, T * b, int ldb, int c0, int c1, bool unit){
+    for(int i = 0; i < n; i++){
+        T * bi = b + static_cast<size_t>(i) * ldb;
+        const T * li = l + static_cast<size_t>(i) * ldl;
+        for(int j = 0; j < i; j++){
+            T s = li[j];
+            const T * bj = b + static_cast<size_t>(j) * ldb;
+            for(int c = c0; c < c1; c++)
+                bi[c] -= s * bj[c];
+        }
+        if(!unit)
+            for(int c = c0; c < c1; c++)
+                bi[c] /= li[i];
+    }
+}
+
+// solves u x = b in place, u upper triangular
+template <typename T>
+void linalgBackward(const T * u, int ldu, int n, T * b, int ldb, int c0, int c1){
+    for(int i = n - 1; i >= 0; i--){
+        T * bi = b + static_cast<size_t>(i) * ldb;
+        const T * ui = u + static_cast<size_t>(i) * ldu;
+        for(int j = i + 1; j < n; j++){
+            T s = ui[j];
+            const T * bj = b + static_cast<size_t>(j) * ldb;
+            for(int c = c0; c < c1; c++)
+                bi[c] -= s * bj[c];
+        }
+        for(int c = c0; c < c1; c++)
+            bi[c] /= ui[i];
+    }
+}
+
+// solves l^T x = b in place, l lower triangular, by columns of l^T so
+// that l is still read along its rows
+template <typename T>
+void linalgBackwardTransposed(const T * l, int ldl, int n, T * b, int ldb, int c0, int c1){
+    for(int i = n - 1; i >= 0; i--){
+        T * bi = b + static_cast<size_t>(i) * ldb;
+        const T * li = l + static_cast<size_t>(i) * ldl;
+        for(int c = c0; c < c1; c++)
+            bi[c] /= li[i];
+        for(int j = 0; j < i; j++){
+            T s = li[j];
+            T * bj = b + static_cast<size_t>(j) * ldb;
+            for(int c = c0; c < c1; c++)
+                bj[c] -= s * bi[c];
+        }
+    }
+}
+
+// a vector as an n x 1 matrix and back
+template <typename T>
+matrix<T> linalgColumn(const vector<T> & v, int n){
+    matrix<T> m(n, 1);
+    std::copy(v.data(), v.data() + n, m.data());
+    return m;
+}
+template <typename T>
+vector<T> linalgVector(const matrix<T> & m, int n){
+    vector<T> v(n);
+    std::copy(m.data(), m.data() + n, v.data());
+    return v;
+}
+
+// p a = l u for square a, l unit lower triangular and u upper
+// triangular, both kept in one matrix
+template <typename T>
+class luFactor {
+public:
+    luFactor(matrix<T> a) : f(std::move(a)), pivot(std::min(f.height(), f.width())) {
+        n = pivot.len();
+        PROFILE_SCOPE("luFactor", 2 * static_cast<uint64_t>(n) * n * n / 3, 0);
+        int w = f.width();
+        for(int k0 = 0; k0 < n; k0 += LINALG_BLOCK){
+            int k1 = std::min(n, k0 + LINALG_BLOCK);
+            panel(k0, k1);
+            // block row of u right of the panel, then everything below it
+            linalgColumns(w - k1, static_cast<double>(k1 - k0) * (k1 - k0) / 2, [&](int b, int e){
+                linalgForward(&f(k0, k0), w, k1 - k0, &f(k0, k1), w, b, e, true);
+            });
+            if(k1 < n)
+                linalgUpdate(&f(k1, k1), w, &f(k1, k0), w, &f(k0, k1), w, n - k1, w - k1, k1 - k0);
+        }
+    }
+
+    // true if a pivot was exactly zero
+    bool singular() const {
+        return zero;
+    }
+
+    // determinant, the product of the pivots
+    T det() const {
+        T d = sign;
+        for(int i = 0; i < n; i++)
+            d *= f(i, i);
+        return d;
+    }
+
+    // x with a x = b, for one right hand side or the columns of a matrix
+    vector<T> solve(const vector<T> & b) const {
+        return linalgVector(solve(linalgColumn(b, n)), n);
+    }
+    matrix<T> solve(matrix<T> b) const {
+        PROFILE_SCOPE("luFactor::solve", 2 * static_cast<uint64_t>(n) * n * b.width(), 0);
+        int k = b.width();
+        for(int i = 0; i < n; i++)
+            if(pivot.data()[i] != i)
+                std::swap_ranges(b.row(i), b.row(i) + k, b.row(pivot.data()[i]));
+        linalgColumns(k, static_cast<double>(n) * n, [&](int c0, int c1){
+            linalgForward(f.data(), f.width(), n, b.data(), k, c0, c1, true);
+            linalgBackward(f.data(), f.width(), n, b.data(), k, c0, c1);
+        });
+        return b;
+    }
+
+    matrix<T> inverse() const {
+        return solve(matrix<T>::identity(n));
+    }
+
+    // factors, l with its unit diagonal filled in
+    matrix<T> lower() const {
+        matrix<T> l(n, n);
+        for(int i = 0; i < n; i++){
+            std::copy(f.row(i), f.row(i) + i, l.row(i));
+            l(i, i) = 1;
+        }
+        return l;
+    }
+    matrix<T> upper() const {
+        matrix<T> u(n, n);
+        for(int i = 0; i < n; i++)
+            std::copy(f.row(i) + i, f.row(i) + n, u.row(i) + i);
+        return u;
+    }
+
+    // row swapped with row i at step i
+    int swapped(int i) const {
+        return pivot.data()[i];
+    }
+
+private:
+    matrix<T> f;
+    vector<int> pivot;
+    int n, sign = 1;
+    bool zero = false;
+
+    // unblocked elimination of columns [k0, k1), rows k0 down; whole
+    // rows are swapped, which is contiguous in row major storage
+    void panel(int k0, int k1) {
+        int w = f.width();
+        for(int j = k0; j < k1; j++){
+            int p = j;
+            for(int i = j + 1; i < n; i++)
+                if(std::abs(f(i, j)) > std::abs(f(p, j)))
+                    p = i;
+            pivot[j] = p;
+            if(p != j){
+                std::swap_ranges(f.row(j), f.row(j) + w, f.row(p));
+                sign = -sign;
+            }
+            T d = f(j, j);
+            if(d == 0){
+                zero = true;
+                continue;
+            }
+            const T * rj = f.row(j);
+            parallelFor(n - j - 1, std::max(1, LINALG_PARALLEL / (k1 - j)), [&](int b, int e){
+                for(int i = j + 1 + b; i < j + 1 + e; i++){
+                    T * ri = f.row(i);
+                    T l = ri[j] /= d;
+                    for(int c = j + 1; c < k1; c++)
+                        ri[c] -= l * rj[c];
+                }
+            });
+        }
+    }
+};
+
+// a = l l^T for symmetric positive definite a, read from and kept in
+// its lower triangle
+template <typename T>
+class choleskyFactor {
+public:
+    choleskyFactor(matrix<T> a) : f(std::move(a)) {
+        n = std::min(f.height(), f.width());
+        PROFILE_SCOPE("choleskyFactor", static_cast<uint64_t>(n) * n * n / 3, 0);
+        int w = f.width();
+        std::vector<T> t;
+        for(int k0 = 0; k0 < n && good; k0 += LINALG_BLOCK){
+            int k1 = std::min(n, k0 + LINALG_BLOCK), kb = k1 - k0;
+            if(!diagonal(k0, k1))
+                break;
+            // block column of l below the diagonal block
+            parallelFor(n - k1, std::max(1, LINALG_PARALLEL / (kb * kb)), [&](int b, int e){
+                for(int i = k1 + b; i < k1 + e; i++){
+                    T * ri = f.row(i);
+                    for(int j = k0; j < k1; j++){
+                        const T * rj = f.row(j);
+                        T s = ri[j];
+                        for(int p = k0; p < j; p++)
+                            s -= ri[p] * rj[p];
+                        ri[j] = s / rj[j];
+                    }
+                }
+            });
+            if(k1 == n)
+                break;
+            // its transpose, so the lower triangle update reads rows
+            t.resize(static_cast<size_t>(kb) * (n - k1));
+            for(int i = k1; i < n; i++)
+                for(int j = 0; j < kb; j++)
+                    t[static_cast<size_t>(j) * (n - k1) + i - k1] = f(i, k0 + j);
+            linalgUpdate(&f(k1, k1), w, &f(k1, k0), w, t.data(), n - k1, n - k1, n - k1, kb, true);
+        }
+    }
+
+    // false if a was not positive definite; then nothing past the
+    // failing column is factored
+    bool positive() const {
+        return good;
+    }
+
+    // determinant and its log, which does not overflow
+    T det() const {
+        return std::exp(logDet());
+    }
+    T logDet() const {
+        T s = 0;
+        for(int i = 0; i < n; i++)
+            s += std::log(f(i, i));
+        return 2 * s;
+    }
+
+    vector<T> solve(const vector<T> & b) const {
+        return linalgVector(solve(linalgColumn(b, n)), n);
+    }
+    matrix<T> solve(matrix<T> b) const {
+        PROFILE_SCOPE("choleskyFactor::solve", 2 * static_cast<uint64_t>(n) * n * b.width(), 0);
+        int k = b.width();
+        linalgColumns(k, static_cast<double>(n) * n, [&](int c0, int c1){
+            linalgForward(f.data(), f.width(), n, b.data(), k, c0, c1, false);
+            linalgBackwardTransposed(f.data(), f.width(), n, b.data(), k, c0, c1);
+        });
+        return b;
+    }
+
+    matrix<T> inverse() const {
+        return solve(matrix<T>::identity(n));
+    }
+
+    // l, zeros above the diagonal
+    matrix<T> lower() const {
+        matrix<T> l(n, n);
+        for(int i = 0; i < n; i++)
+            std::copy(f.row(i), f.row(i) + i + 1, l.row(i));
+        return l;
+    }
+
+private:
+    matrix<T> f;
+    int n;
+    bool good = true;
+
+    // unblocked factor of the diagonal block [k0, k1)
+    bool diagonal(int k0, int k1) {
+        for(int j = k0; j < k1; j++){
+            T * rj = f.row(j);
+            T d = rj[j];
+            for(int p = k0; p < j; p++)
+                d -= rj[p] * rj[p];
+            // NaN fails too
+            if(!(d > 0)){
+                good = false;
+                return false;
+            }
+            rj[j] = d = std::sqrt(d);
+            for(int i = j + 1; i < k1; i++){
+                T * ri = f.row(i);
+                T s = ri[j];
+                for(int p = k0; p < j; p++)
+                    s -= ri[p] * rj[p];
+                ri[j] = s / d;
+            }
+        }
+        return true;
+    }
+};
+
+// a = q r for m x n a with m >= n, q a product of n Householder
+// reflections kept below the diagonal and r upper triangular. Each
+// panel's reflections are also kept as one block reflection
+// i - v t v^T, with t upper triangular, which is how they are applied
+// to the rest of the matrix and to right hand sides
+template <typename T>
+class qrFactor {
+public:
+    qrFactor(matrix<T> a) : f(std::move(a)), tau(std::min(f.height(), f.width())), t(LINALG_BLOCK, tau.len()) {
+        m = f.height();
+        n = tau.len();
+        PROFILE_SCOPE("qrFactor", 2 * static_cast<uint64_t>(n) * n * (m - n / 3), 0);
+        for(int k0 = 0; k0 < n; k0 += LINALG_BLOCK){
+            int k1 = std::min(n, k0 + LINALG_BLOCK);
+            panel(k0, k1);
+            block(k0, k1);
+            apply(k0, k1, f.data(), f.width(), k1, f.width(), true);
+        }
+    }
+
+    // false if a diagonal entry of r is negligible next to the largest
+    bool fullRank() const {
+        T top = 0;
+        for(int i = 0; i < n; i++)
+            top = std::max(top, std::abs(f(i, i)));
+        for(int i = 0; i < n; i++)
+            if(std::abs(f(i, i)) <= top * std::max(m, n) * std::numeric_limits<T>::epsilon())
+                return false;
+        return n > 0 && top > 0;
+    }
+
+    // x minimizing |a x - b|, the exact solution when a is square; one
+    // right hand side of m values or the columns of an m row matrix
+    vector<T> solve(const vector<T> & b) const {
+        return linalgVector(solve(linalgColumn(b, m)), n);
+    }
+    matrix<T> solve(matrix<T> b) const {
+        PROFILE_SCOPE("qrFactor::solve", 4 * static_cast<uint64_t>(m) * n * b.width(), 0);
+        int k = b.width();
+        for(int k0 = 0; k0 < n; k0 += LINALG_BLOCK)
+            apply(k0, std::min(n, k0 + LINALG_BLOCK), b.data(), k, 0, k, true);
+        linalgColumns(k, static_cast<double>(n) * n / 2, [&](int c0, int c1){
+            linalgBackward(f.data(), f.width(), n, b.data(), k, c0, c1);
+        });
+        matrix<T> x(n, k);
+        std::copy(b.data(), b.data() + static_cast<size_t>(n) * k, x.data());
+        return x;
+    }
+
+    // r, n x n, and the first n columns of q, m x n
+    matrix<T> r() const {
+        matrix<T> u(n, n);
+        for(int i = 0; i < n; i++)
+            std::copy(f.row(i) + i, f.row(i) + n, u.row(i) + i);
+        return u;
+    }
+    matrix<T> q() const {
+        matrix<T> e(m, n);
+        for(int i = 0; i < n; i++)
+            e(i, i) = 1;
+        for(int k0 = (n - 1) / LINALG_BLOCK * LINALG_BLOCK; k0 >= 0; k0 -= LINALG_BLOCK)
+            apply(k0, std::min(n, k0 + LINALG_BLOCK), e.data(), n, 0, n, false);
+        return e;
+    }
+
+private:
+    matrix<T> f;
+    vector<T> tau;
+    matrix<T> t;
+    int m, n;
+
+    // entry r of reflection k0 + p, as stored below the diagonal
+    T reflector(int r, int k0, int p) const {
+        return r < k0 + p ? 0 : (r == k0 + p ? 1 : f(r, k0 + p));
+    }
+
+    // unblocked reflections of columns [k0, k1), each applied to the
+    // rest of the panel by rows
+    void panel(int k0, int k1) {
+        std::vector<T> w(k1 - k0);
+        for(int j = k0; j < k1; j++){
+            T s = 0;
+            for(int i = j + 1; i < m; i++)
+                s += f(i, j) * f(i, j);
+            T alpha = f(j, j);
+            if(s == 0){
+                tau[j] = 0;
+                continue;
+            }
+            T beta = -std::copysign(std::sqrt(alpha * alpha + s), alpha);
+            tau[j] = (beta - alpha) / beta;
+            T scale = 1 / (alpha - beta);
+            for(int i = j + 1; i < m; i++)
+                f(i, j) *= scale;
+            f(j, j) = beta;
+            // w = v^T a, then a -= tau v w, over the panel columns right of j
+            int c1 = k1 - j - 1;
+            std::copy(f.row(j) + j + 1, f.row(j) + k1, w.begin());
+            for(int i = j + 1; i < m; i++){
+                const T * ri = f.row(i);
+                for(int c = 0; c < c1; c++)
+                    w[c] += ri[j] * ri[j + 1 + c];
+            }
+            for(int c = 0; c < c1; c++)
+                w[c] *= tau[j];
+            for(int i = j; i < m; i++){
+                T * ri = f.row(i);
+                T v = i == j ? 1 : ri[j];
+                for(int c = 0; c < c1; c++)
+                    ri[j + 1 + c] -= v * w[c];
+            }
+        }
+    }
+
+    // t for columns [k0, k1), from the inner products of the reflections
+    void block(int k0, int k1) {
+        int kb = k1 - k0;
+        std::vector<T> g(static_cast<size_t>(kb) * kb), v(kb);
+        for(int i = k0; i < m; i++){
+            for(int p = 0; p < kb; p++)
+                v[p] = reflector(i, k0, p);
+            for(int r = 0; r < kb; r++)
+                if(v[r] != 0)
+                    for(int p = r + 1; p < kb; p++)
+                        g[static_cast<size_t>(r) * kb + p] += v[r] * v[p];
+        }
+        for(int p = 0; p < kb; p++){
+            t(p, k0 + p) = tau[k0 + p];
+            for(int q = 0; q < p; q++){
+                T s = 0;
+                for(int r = q; r < p; r++)
+                    s += t(q, k0 + r) * g[static_cast<size_t>(r) * kb + p];
+                t(q, k0 + p) = -tau[k0 + p] * s;
+            }
+        }
+    }
+
+    // applies the block reflection of columns [k0, k1), transposed for
+    // q^T, to columns [c0, c1) of the m row matrix c: w = v^T c, then
+    // w = t^T w or t w, then c -= v w, split by columns
+    void apply(int k0, int k1, T * c, int ldc, int c0, int c1, bool transposed) const {
+        int kb = k1 - k0;
+        linalgColumns(c1 - c0, 4.0 * (m - k0) * kb, [&](int b, int e){
+            b += c0;
+            e += c0;
+            for(int j0 = b; j0 < e; j0 += LINALG_COLUMNS){
+                int j1 = std::min(e, j0 + LINALG_COLUMNS), cw = j1 - j0;
+                std::vector<T> w(static_cast<size_t>(kb) * cw);
+                for(int i = k0; i < m; i++){
+                    const T * ci = c + static_cast<size_t>(i) * ldc + j0;
+                    for(int p = 0; p < kb && k0 + p <= i; p++){
+                        T v = reflector(i, k0, p);
+                        T * wp = &w[static_cast<size_t>(p) * cw];
+                        for(int j = 0; j < cw; j++)
+                            wp[j] += v * ci[j];
+                    }
+                }
+                if(transposed)
+                    for(int p = kb - 1; p >= 0; p--)
+                        combine(k0, w.data(), cw, p, 0, p + 1, true);
+                else
+                    for(int p = 0; p < kb; p++)
+                        combine(k0, w.data(), cw, p, p, kb, false);
+                for(int i = k0; i < m; i++){
+                    T * ci = c + static_cast<size_t>(i) * ldc + j0;
+                    for(int p = 0; p < kb && k0 + p <= i; p++){
+                        T v = reflector(i, k0, p);
+                        const T * wp = &w[static_cast<size_t>(p) * cw];
+                        for(int j = 0; j < cw; j++)
+                            ci[j] -= v * wp[j];
+                    }
+                }
+            }
+        });
+    }
+
+    // row p of w replaced by the sum over q in [q0, q1) of t(q, p) w[q]
+    // if transposed, or of t(p, q) w[q]; rows are visited in the order
+    // that leaves the rows still to be read untouched
+    void combine(int k0, T * w, int cw, int p, int q0, int q1, bool transposed) const {
+        std::vector<T> s(cw);
+        for(int q = q0; q < q1; q++){
+            T a = transposed ? t(q, k0 + p) : t(p, k0 + q);
+            const T * wq = w + static_cast<size_t>(q) * cw;
+            for(int j = 0; j < cw; j++)
+                s[j] += a * wq[j];
+        }
+        std::copy(s.begin(), s.end(), w + static_cast<size_t>(p) * cw);
+    }
+};
+
+// c = a b, blocked and split over the thread pool
+template <typename T>
+matrix<T> multiply(const matrix<T> & a, const matrix<T> & b){
+    PROFILE_SCOPE("multiply", 2 * static_cast<uint64_t>(a.height()) * a.width() * b.width(), 0);
+    matrix<T> c(a.height(), b.width());
+    for(int k0 = 0; k0 < a.width(); k0 += LINALG_BLOCK){
+        int kb = std::min(a.width(), k0 + LINALG_BLOCK) - k0;
+        // c -= (-a) b, so the update kernel does the work
+        matrix<T> p(a.height(), kb);
+        for(int i = 0; i < a.height(); i++)
+            for(int k = 0; k < kb; k++)
+                p(i, k) = -a(i, k0 + k);
+        linalgUpdate(c.data(), c.width(), p.data(), kb, b.row(k0), b.width(), c.height(), c.width(), kb);
+    }
+    return c;
+}
+
+// x with a x = b for square a, by LU
+template <typename T>
+vector<T> solve(const matrix<T> & a, const vector<T> & b){
+    return luFactor<T>(a).solve(b);
+}
+template <typename T>
+matrix<T> solve(const matrix<T> & a, const matrix<T> & b){
+    return luFactor<T>(a).solve(b);
+}
+
+template <typename T>
+matrix<T> inverse(const matrix<T> & a){
+    return luFactor<T>(a).inverse();
+}
+
+template <typename T>
+T det(const matrix<T> & a){
+    return luFactor<T>(a).det();
+}
+
+// x minimizing |a x - b| for a with at least as many rows as columns,
+// by QR
+template <typename T>
+vector<T> leastSquares(const matrix<T> & a, const vector<T> & b){
+    return qrFactor<T>(a).solve(b);
+}
+
+#endif /* linalg_h */
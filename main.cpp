@@ -7,8 +7,11 @@
 
 #include <iostream>
 #include <vector>
+#include <string>
 #include <cmath>
 #include "math.h"
+#include "tally.h"
+#include "ingest.h"
 vec4 floor(vec4 v){
     return vec4(std::floor(v.x), std::floor(v.y), std::floor(v.z), std::floor(v.w));
 }
@@ -59,43 +62,60 @@ int main(int argc, const char * argv[]) {
     vec4 Tampa        = vec4(    1,          0,           1,           0        );*/
     
     // Market | painting | resurfacing| cleaning | carpet cleaning
-    vec4 Austin       = vec4(4, 1, 6, 1);
-    vec4 Jacksonville = vec4(2, 3, 3, 0);
-    vec4 Tampa        = vec4(1, 0, 1, 0);
-
-    Austin *= 2.0 / 3.0;
-    Jacksonville *= 2.0 / 3.0;
-    Tampa *= 2.0 / 3.0;
-    
-    
-    Austin += vec4(0, 0, 4.0 / 300.0, 0) * 49;
-    Austin += vec4(0, 0, 5.0 / 300.0, 0) * 49;
-    Austin += vec4(0, 0, 3.0 / 300.0, 0) * 47;
-    Tampa  += vec4(0, 2.0 / 100.0, 1.0 / 300.0, 0) * 122;
-    Austin += vec4(2.0 / 200.0, 2.0 / 100.0, 3.0 / 300, 0) * 120;
-    
-    
-    Austin +=       min(floor(vec4(2,  0,  0,  0) / 6), 2.0);
-    Tampa +=        min(floor(vec4(2,  0,  0,  0) / 6), 2.0);
-    Jacksonville += min(floor(vec4(3,  0,  0,  0) / 6), 2.0);
-    Jacksonville += min(floor(vec4(1,  10, 1,  1) / 6), 2.0);
-    Austin +=       min(floor(vec4(43, 13, 1,  2) / 6), 2.0);
-    Tampa +=        min(floor(vec4(0,  0,  6,  0) / 6), 2.0);
-    Tampa +=        min(floor(vec4(4,  0,  0,  0) / 6), 2.0);
-    Austin +=       min(floor(vec4(0,  0,  13, 0) / 6), 2.0);
-    Austin +=       min(floor(vec4(0,  0,  6,  0) / 6), 2.0);
-    Austin +=       min(floor(vec4(0,  11, 29, 30)/ 6), 2.0);
-    Jacksonville += min(floor(vec4(0,  0,  7,  0) / 6), 2.0);
-    Jacksonville += min(floor(vec4(0,  0,  6,  0) / 6), 2.0);
-    Tampa +=        min(floor(vec4(0,  0,  8,  0) / 6), 2.0);
-    Jacksonville += min(floor(vec4(0,  10, 4,  0) / 6), 2.0);
-    Tampa +=        min(floor(vec4(0,  10, 0,  0) / 6), 2.0);
-    Austin +=       min(floor(vec4(5,  6,  0,  0) / 6), 2.0);
-    
-    
-    floor(Austin).print();
-    floor(Jacksonville).print();
-    floor(Tampa).print();
+    std::vector<std::string> markets = {"Austin", "Jacksonville", "Tampa"};
+    records base(markets), weighted(markets), jobs(markets);
+    
+    // starting counts
+    base.add("Austin",       vec4(4, 1, 6, 1));
+    base.add("Jacksonville", vec4(2, 3, 3, 0));
+    base.add("Tampa",        vec4(1, 0, 1, 0));
+    
+    // counts over the last period, weighted by how many went out
+    weighted.add("Austin", vec4(0, 0, 4, 0) * 49);
+    weighted.add("Austin", vec4(0, 0, 5, 0) * 49);
+    weighted.add("Austin", vec4(0, 0, 3, 0) * 47);
+    weighted.add("Tampa",  vec4(0, 2, 1, 0) * 122);
+    weighted.add("Austin", vec4(2, 2, 3, 0) * 120);
+    
+    // single jobs
+    jobs.add("Austin",       vec4(2,  0,  0,  0));
+    jobs.add("Tampa",        vec4(2,  0,  0,  0));
+    jobs.add("Jacksonville", vec4(3,  0,  0,  0));
+    jobs.add("Jacksonville", vec4(1,  10, 1,  1));
+    jobs.add("Austin",       vec4(43, 13, 1,  2));
+    jobs.add("Tampa",        vec4(0,  0,  6,  0));
+    jobs.add("Tampa",        vec4(4,  0,  0,  0));
+    jobs.add("Austin",       vec4(0,  0,  13, 0));
+    jobs.add("Austin",       vec4(0,  0,  6,  0));
+    jobs.add("Austin",       vec4(0,  11, 29, 30));
+    jobs.add("Jacksonville", vec4(0,  0,  7,  0));
+    jobs.add("Jacksonville", vec4(0,  0,  6,  0));
+    jobs.add("Tampa",        vec4(0,  0,  8,  0));
+    jobs.add("Jacksonville", vec4(0,  10, 4,  0));
+    jobs.add("Tampa",        vec4(0,  10, 0,  0));
+    jobs.add("Austin",       vec4(5,  6,  0,  0));
+    
+    std::vector<vec4> totals;
+    tally perJob = tally().divide(6).floor().min(2.0);
+    tally().scale(2.0 / 3.0).sum(base, totals);
+    tally().divide(vec4(200, 100, 300, 1)).sum(weighted, totals);
+    perJob.sum(jobs, totals);
+    
+    // more jobs streamed from record files given on the command line
+    records batch(markets);
+    for(int i = 1; i < argc; i++){
+        std::string path = argv[i];
+        auto add = [&](records & b){ perJob.sum(b, totals); };
+        if(path.size() > 4 && path.compare(path.size() - 4, 4, ".bin") == 0)
+            streamBinary(path, batch, add);
+        else
+            streamCsv(path, batch, add);
+    }
+    
+    for(int k = 0; k < static_cast<int>(totals.size()); k++){
+        std::cout << batch.name(k) << ": ";
+        floor(totals[k]).print();
+    }
     
     
     
@@ -10,6 +10,16 @@
 #ifndef math_h
 #define math_h
 
+#include <new>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include "profile.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
 // TODO: compy constructors
 
 // 2D vector structure
@@ -368,7 +378,38 @@ struct vec4 {
     }
 };
 
-// 2 x 2 matrix structure TODO: rotation, scaling
+// Cody-Waite reduction by pi/2: 2/pi, and pi/2 split in three parts
+// whose products with the quadrant are exact
+const double sinCosInvHalfPi = 0.63661977236758134308;
+const double sinCosHalfPi[3] = {1.57079632673412561417e+00, 6.07710050630396597660e-11, 2.02226624871116645580e-21};
+
+// sines and cosines of n angles in one pass; the angles are reduced
+// to [-pi/4, pi/4] and run through the fdlibm kernel polynomials with
+// no branches, so the loop vectorizes. angles past 1e6 fall back to libm
+void sinCos(const double * t, double * s, double * c, int n){
+    for(int i = 0; i < n; i++){
+        double x = t[i], q = std::nearbyint(x * sinCosInvHalfPi);
+        // huge, infinite and NaN angles are redone below, but their
+        // quadrant must still convert to an integer safely
+        q = std::abs(x) <= 1e6 ? q : 0.0;
+        double r = x - q * sinCosHalfPi[0] - q * sinCosHalfPi[1] - q * sinCosHalfPi[2];
+        double z = r * r;
+        double sr = r + r * z * (-1.66666666666666324348e-01 + z * (8.33333333332248946124e-03 + z * (-1.98412698298579493134e-04 + z * (2.75573137070700676789e-06 + z * (-2.50507602534068634195e-08 + z * 1.58969099521155010221e-10)))));
+        double cr = 1.0 - 0.5 * z + z * z * (4.16666666666666019037e-02 + z * (-1.38888888888741095749e-03 + z * (2.48015872894767294178e-05 + z * (-2.75573143513906633035e-07 + z * (2.08757232129817482790e-09 + z * -1.13596475577881948265e-11)))));
+        long k = static_cast<long>(q);
+        double a = k & 1 ? cr : sr, b = k & 1 ? sr : cr;
+        s[i] = k & 2 ? -a : a;
+        c[i] = (k + 1) & 2 ? -b : b;
+    }
+    for(int i = 0; i < n; i++){
+        if(!(std::abs(t[i]) <= 1e6)){
+            s[i] = std::sin(t[i]);
+            c[i] = std::cos(t[i]);
+        }
+    }
+}
+
+// 2 x 2 matrix structure TODO: scaling
 struct mat2 {
     vec2 x, y;
     
@@ -383,20 +424,33 @@ struct mat2 {
         return vec2(x * v, y * v);
     }
     
-    // matrix multiplication
+    // matrix multiplication, this matrix applied after m: row i of the
+    // product is row i of this combining the rows of m
     mat2 operator * (mat2 m){
-        return mat2(m * x, m * y);
+        PROFILE_COUNT("mat2::operator*", 12, 0);
+        return mat2(m.x * x.x + m.y * x.y, m.x * y.x + m.y * y.y);
     }
     
-    // rotation matrix
+    // determinant and inverse, singular matrices giving infinities or NaNs
+    double det(){
+        return x.x * y.y - x.y * y.x;
+    }
+    mat2 inverse(){
+        double d = 1 / det();
+        return mat2(vec2(y.y * d, -x.y * d), vec2(-y.x * d, x.x * d));
+    }
+    
+    // rotation matrix, the same as the z rotation of mat3
     mat2 rotation(double d){
-        double s = std::sin(d), c = std::cos(d);
-        return mat2(vec2(s, c), vec2(c, -s));
+        double s, c;
+        sinCos(&d, &s, &c, 1);
+        return mat2(vec2(c, s), vec2(-s, c));
     }
     
     // rotate this matrix
     void rotate(double d){
-        //mat3 m = mat3.rotation(dx, dy, dz); TODO: figure this out
+        mat2 r = rotation(d);
+        * this = mat2(x * r.x.x + y * r.x.y, x * r.y.x + y * r.y.y);
     }
     
     void print(){
@@ -405,7 +459,7 @@ struct mat2 {
     }
 };
 
-// 3 x 3 matrix structure TODO: rotation, scaling
+// 3 x 3 matrix structure TODO: scaling
 struct mat3 {
     vec3 x, y, z;
     
@@ -421,14 +475,31 @@ struct mat3 {
         return vec3(x * v, y * v, z * v);
     }
     
-    // matrix multiplication
+    // matrix multiplication, this matrix applied after m
     mat3 operator * (mat3 m){
-        return mat3(m * x, m * y, m * z);
+        PROFILE_COUNT("mat3::operator*", 45, 0);
+        return mat3(m.x * x.x + m.y * x.y + m.z * x.z,
+                    m.x * y.x + m.y * y.y + m.z * y.z,
+                    m.x * z.x + m.y * z.y + m.z * z.z);
+    }
+    
+    // determinant and inverse, singular matrices giving infinities or NaNs
+    double det(){
+        return x * (y ^ z);
+    }
+    mat3 inverse(){
+        vec3 a = y ^ z, b = z ^ x, c = x ^ y;
+        double d = 1 / (x * a);
+        return mat3(vec3(a.x, b.x, c.x) * d, vec3(a.y, b.y, c.y) * d, vec3(a.z, b.z, c.z) * d);
     }
     
     // rotation matrix
     mat3 rotation(double dx, double dy, double dz){
-        double sx = std::sin(dx), cx = std::cos(dx), sy = std::sin(dy), cy = std::cos(dy), sz = std::sin(dz), cz = std::cos(dz);
+        double t[3] = {dx, dy, dz}, s[3], c[3];
+        sinCos(t, s, c, 3);
+        return rotation(s[0], c[0], s[1], c[1], s[2], c[2]);
+    }
+    mat3 rotation(double sx, double cx, double sy, double cy, double sz, double cz){
         return mat3(vec3(cz * cy, sz * cy, -sy),
                     vec3(cz * sy * sx - sz * cx, sz * sy * sx + cz * cx, cy * sx),
                     vec3(cz * sy * cx + sz * sx, sz * sy * cx - cz * sx, cy * cx));
@@ -436,7 +507,10 @@ struct mat3 {
     
     // rotate this matrix
     void rotate(double dx, double dy, double dz){
-        //mat3 m = mat3.rotation(dx, dy, dz); TODO: figure this out
+        mat3 r = rotation(dx, dy, dz);
+        * this = mat3(x * r.x.x + y * r.x.y + z * r.x.z,
+                      x * r.y.x + y * r.y.y + z * r.y.z,
+                      x * r.z.x + y * r.z.y + z * r.z.z);
     }
     
     void print(){
@@ -446,7 +520,9 @@ struct mat3 {
     }
 };
 
-// 4 x 4 matrix structure TODO: all
+// 4 x 4 matrix structure, rows x, y, z, w acting on column vectors, so
+// a translation sits in the last column and w is (0, 0, 0, 1) for
+// affine transforms
 struct mat4 {
     vec4 x, y, z, w;
     
@@ -463,9 +539,123 @@ struct mat4 {
         return vec4(x * v, y * v, z * v, w * v);
     }
     
-    // matrix multiplication
+    // matrix multiplication, this matrix applied after m, so a chain
+    // like projection * view * model reads right to left
     mat4 operator * (mat4 m){
-        return mat4(m * x, m * y, m * z, m * w);
+        PROFILE_COUNT("mat4::operator*", 112, 0);
+        return mat4(m.x * x.x + m.y * x.y + m.z * x.z + m.w * x.w,
+                    m.x * y.x + m.y * y.y + m.z * y.z + m.w * y.w,
+                    m.x * z.x + m.y * z.y + m.z * z.z + m.w * z.w,
+                    m.x * w.x + m.y * w.y + m.z * w.z + m.w * w.w);
+    }
+    
+    // point (w = 1) and direction (w = 0) transformation, points divided
+    // through by w when the matrix is a projection
+    vec3 point(vec3 p){
+        vec4 v = * this * vec4(p.x, p.y, p.z, 1.0);
+        if(isAffine())
+            return vec3(v.x, v.y, v.z);
+        return vec3(v.x / v.w, v.y / v.w, v.z / v.w);
+    }
+    vec3 direction(vec3 d){
+        return vec3(x.x * d.x + x.y * d.y + x.z * d.z,
+                    y.x * d.x + y.y * d.y + y.z * d.z,
+                    z.x * d.x + z.y * d.y + z.z * d.z);
+    }
+    
+    // whether the bottom row is (0, 0, 0, 1)
+    bool isAffine(){
+        return w.x == 0 && w.y == 0 && w.z == 0 && w.w == 1;
+    }
+    
+    // transpose
+    mat4 transpose(){
+        return mat4(vec4(x.x, y.x, z.x, w.x), vec4(x.y, y.y, z.y, w.y),
+                    vec4(x.z, y.z, z.z, w.z), vec4(x.w, y.w, z.w, w.w));
+    }
+    
+    // determinant, from the 2 x 2 minors of the top and bottom row pairs
+    double det(){
+        double s0 = x.x * y.y - y.x * x.y, s1 = x.x * y.z - y.x * x.z, s2 = x.x * y.w - y.x * x.w;
+        double s3 = x.y * y.z - y.y * x.z, s4 = x.y * y.w - y.y * x.w, s5 = x.z * y.w - y.z * x.w;
+        double c5 = z.z * w.w - w.z * z.w, c4 = z.y * w.w - w.y * z.w, c3 = z.y * w.z - w.y * z.z;
+        double c2 = z.x * w.w - w.x * z.w, c1 = z.x * w.z - w.x * z.z, c0 = z.x * w.y - w.x * z.y;
+        return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    }
+    
+    // inverse, through the 3 x 3 part and the translation alone when the
+    // matrix is affine. singular matrices give infinities or NaNs
+    mat4 inverse(){
+        if(isAffine()){
+            double a = y.y * z.z - y.z * z.y, b = y.z * z.x - y.x * z.z, c = y.x * z.y - y.y * z.x;
+            double d = 1 / (x.x * a + x.y * b + x.z * c);
+            vec3 r0(a * d, (x.z * z.y - x.y * z.z) * d, (x.y * y.z - x.z * y.y) * d);
+            vec3 r1(b * d, (x.x * z.z - x.z * z.x) * d, (x.z * y.x - x.x * y.z) * d);
+            vec3 r2(c * d, (x.y * z.x - x.x * z.y) * d, (x.x * y.y - x.y * y.x) * d);
+            vec3 t(x.w, y.w, z.w);
+            return mat4(vec4(r0.x, r0.y, r0.z, -(r0 * t)), vec4(r1.x, r1.y, r1.z, -(r1 * t)),
+                        vec4(r2.x, r2.y, r2.z, -(r2 * t)), vec4(0.0, 0.0, 0.0, 1.0));
+        }
+        double s0 = x.x * y.y - y.x * x.y, s1 = x.x * y.z - y.x * x.z, s2 = x.x * y.w - y.x * x.w;
+        double s3 = x.y * y.z - y.y * x.z, s4 = x.y * y.w - y.y * x.w, s5 = x.z * y.w - y.z * x.w;
+        double c5 = z.z * w.w - w.z * z.w, c4 = z.y * w.w - w.y * z.w, c3 = z.y * w.z - w.y * z.z;
+        double c2 = z.x * w.w - w.x * z.w, c1 = z.x * w.z - w.x * z.z, c0 = z.x * w.y - w.x * z.y;
+        double d = 1 / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+        return mat4(vec4(( y.y * c5 - y.z * c4 + y.w * c3) * d, (-x.y * c5 + x.z * c4 - x.w * c3) * d,
+                         ( w.y * s5 - w.z * s4 + w.w * s3) * d, (-z.y * s5 + z.z * s4 - z.w * s3) * d),
+                    vec4((-y.x * c5 + y.z * c2 - y.w * c1) * d, ( x.x * c5 - x.z * c2 + x.w * c1) * d,
+                         (-w.x * s5 + w.z * s2 - w.w * s1) * d, ( z.x * s5 - z.z * s2 + z.w * s1) * d),
+                    vec4(( y.x * c4 - y.y * c2 + y.w * c0) * d, (-x.x * c4 + x.y * c2 - x.w * c0) * d,
+                         ( w.x * s4 - w.y * s2 + w.w * s0) * d, (-z.x * s4 + z.y * s2 - z.w * s0) * d),
+                    vec4((-y.x * c3 + y.y * c1 - y.z * c0) * d, ( x.x * c3 - x.y * c1 + x.z * c0) * d,
+                         (-w.x * s3 + w.y * s1 - w.z * s0) * d, ( z.x * s3 - z.y * s1 + z.z * s0) * d));
+    }
+    
+    // affine builders
+    mat4 translation(vec3 t){
+        return mat4(vec4(1.0, 0.0, 0.0, t.x), vec4(0.0, 1.0, 0.0, t.y), vec4(0.0, 0.0, 1.0, t.z));
+    }
+    mat4 scaling(vec3 s){
+        return mat4(vec4(s.x, 0.0, 0.0, 0.0), vec4(0.0, s.y, 0.0, 0.0), vec4(0.0, 0.0, s.z, 0.0));
+    }
+    mat4 affine(mat3 m, vec3 t = vec3()){
+        return mat4(vec4(m.x.x, m.x.y, m.x.z, t.x), vec4(m.y.x, m.y.y, m.y.z, t.y), vec4(m.z.x, m.z.y, m.z.z, t.z));
+    }
+    mat4 rotation(double dx, double dy, double dz){
+        return affine(mat3().rotation(dx, dy, dz));
+    }
+    
+    // camera looking from eye towards target, right handed with -z
+    // forward, as OpenGL expects
+    mat4 lookAt(vec3 eye, vec3 target, vec3 up = vec3(0.0, 1.0, 0.0)){
+        vec3 f = target - eye;
+        f.norm();
+        vec3 s = f ^ up;
+        s.norm();
+        vec3 u = s ^ f;
+        return mat4(vec4(s.x, s.y, s.z, -(s * eye)), vec4(u.x, u.y, u.z, -(u * eye)),
+                    vec4(-f.x, -f.y, -f.z, f * eye));
+    }
+    
+    // projections onto clip space, depth from near to far going to -1 to 1;
+    // fov is the vertical field of view in radians
+    mat4 perspective(double fov, double aspect, double near, double far){
+        double f = 1 / std::tan(fov / 2);
+        return mat4(vec4(f / aspect, 0.0, 0.0, 0.0), vec4(0.0, f, 0.0, 0.0),
+                    vec4(0.0, 0.0, (far + near) / (near - far), 2 * far * near / (near - far)),
+                    vec4(0.0, 0.0, -1.0, 0.0));
+    }
+    mat4 ortho(double left, double right, double bottom, double top, double near, double far){
+        return mat4(vec4(2 / (right - left), 0.0, 0.0, -(right + left) / (right - left)),
+                    vec4(0.0, 2 / (top - bottom), 0.0, -(top + bottom) / (top - bottom)),
+                    vec4(0.0, 0.0, -2 / (far - near), -(far + near) / (far - near)));
+    }
+    
+    void print(){
+        x.print();
+        y.print();
+        z.print();
+        w.print();
     }
 };
 
@@ -482,6 +672,67 @@ vec2 operator * (mat2 m, vec2 v){
     
 //}
 
+// rotation matrices for n angles, with all the trig done up front
+void rotations(const double * t, mat2 * m, int n){
+    double * s = new double[2 * n], * c = s + n;
+    sinCos(t, s, c, n);
+    for(int i = 0; i < n; i++)
+        m[i] = mat2(vec2(c[i], s[i]), vec2(-s[i], c[i]));
+    delete [] s;
+}
+void rotations(const double * dx, const double * dy, const double * dz, mat3 * m, int n){
+    double * s = new double[6 * n], * c = s + 3 * n;
+    sinCos(dx, s, c, n);
+    sinCos(dy, s + n, c + n, n);
+    sinCos(dz, s + 2 * n, c + 2 * n, n);
+    for(int i = 0; i < n; i++)
+        m[i] = m[i].rotation(s[i], c[i], s[n + i], c[n + i], s[2 * n + i], c[2 * n + i]);
+    delete [] s;
+}
+
+// rotation matrices for angles on a grid of 2 pi / steps, for scenes
+// that keep reusing the same handful of orientations. angles are
+// snapped to the nearest step, so it is exact only on the grid
+struct angleCache {
+    int steps;
+    double step;
+    double * s, * c;
+    
+    // constructor
+    angleCache(int n = 4096){
+        steps = n;
+        step = 6.28318530717958647693 / n;
+        s = new double[2 * n];
+        c = s + n;
+        double * t = new double[n];
+        for(int i = 0; i < n; i++)
+            t[i] = i * step;
+        sinCos(t, s, c, n);
+        delete [] t;
+    }
+    angleCache(const angleCache &) = delete;
+    void operator = (const angleCache &) = delete;
+    ~angleCache(){
+        delete [] s;
+    }
+    
+    // grid index of an angle
+    int index(double t){
+        long i = std::lround(t / step) % steps;
+        return static_cast<int>(i < 0 ? i + steps : i);
+    }
+    
+    // rotation matrices
+    mat2 rotation(double d){
+        int i = index(d);
+        return mat2(vec2(c[i], s[i]), vec2(-s[i], c[i]));
+    }
+    mat3 rotation(double dx, double dy, double dz){
+        int x = index(dx), y = index(dy), z = index(dz);
+        return mat3().rotation(s[x], c[x], s[y], c[y], s[z], c[z]);
+    }
+};
+
 // 3D linear transformations
 vec3 operator * (vec3 v, mat3 m){
     return vec3(m.x * v, m.y * v, m.z * v);
@@ -490,6 +741,12 @@ vec3 operator * (mat3 m, vec3 v){
     return vec3(m.x * v, m.y * v, m.z * v);
 }
 
+// 4D linear transformation, mat4 * vec4 being the member alone so that
+// it stays unambiguous for matrix lvalues
+vec4 operator * (vec4 v, mat4 m){
+    return vec4(m.x * v, m.y * v, m.z * v, m.w * v);
+}
+
 // vector absolute value functions
 vec2 abs(vec2 v){
     return vec2(std::abs(v.x), std::abs(v.y));
@@ -528,7 +785,7 @@ int color(int r = 0x0, int g = 0x0, int b = 0x0, int a = 0xff){
     return a << 24 | r << 16 | g << 8 | b;
 }
 
-// complex number structure TODO: exponentiation, modulus,
+// complex number structure
 struct complex {
     double r, i;
     
@@ -558,8 +815,8 @@ struct complex {
         return complex(r - c.r, i - c.i);
     }
     void operator -= (complex c){
-        r -= c.i;
-        r -= c.i;
+        r -= c.r;
+        i -= c.i;
     }
     
     // comlex multiplication
@@ -572,6 +829,15 @@ struct complex {
         i = t * c.i + i * c.r;
     }
     
+    // scaling
+    complex operator * (double s){
+        return complex(r * s, i * s);
+    }
+    void operator *= (double s){
+        r *= s;
+        i *= s;
+    }
+    
     // complex division
     complex operator / (complex c){
         double m = 1 / (c.r * c.r + c.i * c.i);
@@ -583,17 +849,39 @@ struct complex {
         i = (i * c.r - t * c.i) * m;
     }
     
-    // simple exponentiation
+    // integer exponentiation by squaring
     complex operator ^ (int n){
-        complex c = complex(1.0, 0.0);
-        for(; n > 0; n--)
-            c *= complex(r, i);
+        complex c = complex(1.0, 0.0), b = complex(r, i);
+        if(n < 0){
+            b = complex(1.0, 0.0) / b;
+            n = -n;
+        }
+        for(; n > 0; n >>= 1){
+            if(n & 1)
+                c *= b;
+            b *= b;
+        }
         return c;
     }
     
-    // complex exponentiation
+    // complex exponentiation, this ^ c on the principal branch
     complex exp(complex c){
-        return complex(); // TODO: look up formula, finish
+        if(r == 0.0 && i == 0.0)
+            return complex(c.r == 0.0 && c.i == 0.0 ? 1.0 : 0.0, 0.0);
+        double lr = std::log(std::hypot(r, i)), li = std::atan2(i, r);
+        double m = std::exp(c.r * lr - c.i * li), t = c.r * li + c.i * lr;
+        return complex(m * std::cos(t), m * std::sin(t));
+    }
+    
+    // modulus, argument and conjugate
+    double mag(){
+        return std::hypot(r, i);
+    }
+    double arg(){
+        return std::atan2(i, r);
+    }
+    complex conj(){
+        return complex(r, -i);
     }
     
     // print
@@ -602,7 +890,217 @@ struct complex {
     }
 };
 
-// quaternion structure TODO: rotation, multiplication
+// complex exponential and principal logarithm
+complex exp(complex c){
+    double m = std::exp(c.r);
+    return complex(m * std::cos(c.i), m * std::sin(c.i));
+}
+complex log(complex c){
+    return complex(std::log(std::hypot(c.r, c.i)), std::atan2(c.i, c.r));
+}
+
+// complex number from modulus and argument
+complex polar(double m, double t){
+    return complex(m * std::cos(t), m * std::sin(t));
+}
+
+// array of complex numbers stored as separate real and imaginary
+// planes, so element-wise kernels run as plain vectorizable loops
+class complexArray {
+
+private:
+    int length;
+    double * store = nullptr;
+    
+public:
+    double * r, * i;
+    
+    // 'structors
+    complexArray (int l = 0) {
+        length = l;
+        store = new double[2 * l + 1];
+        r = store;
+        i = store + l;
+        for(int k = 0; k < 2 * l; k++)
+            store[k] = 0.0;
+    }
+    complexArray (const complex * c, int l) : complexArray(l) {
+        load(c);
+    }
+    complexArray (const complexArray & a) : complexArray(a.length) {
+        for(int k = 0; k < 2 * length; k++)
+            store[k] = a.store[k];
+    }
+    ~complexArray () {
+        delete [] store;
+    }
+    
+    // copy assignment
+    void operator = (const complexArray & a) {
+        if(this == &a)
+            return;
+        delete [] store;
+        length = a.length;
+        store = new double[2 * length + 1];
+        r = store;
+        i = store + length;
+        for(int k = 0; k < 2 * length; k++)
+            store[k] = a.store[k];
+    }
+    
+    // get length
+    int len () {
+        return length;
+    }
+    
+    // read and write element
+    complex get (int k) {
+        return complex(r[k], i[k]);
+    }
+    void set (int k, complex c) {
+        r[k] = c.r;
+        i[k] = c.i;
+    }
+    
+    // conversion from and to interleaved complex numbers
+    void load (const complex * c) {
+        double * __restrict a = r, * __restrict b = i;
+        for(int k = 0; k < length; k++){
+            a[k] = c[k].r;
+            b[k] = c[k].i;
+        }
+    }
+    void unload (complex * c) {
+        const double * __restrict a = r, * __restrict b = i;
+        for(int k = 0; k < length; k++){
+            c[k].r = a[k];
+            c[k].i = b[k];
+        }
+    }
+    
+    // element-wise addition and subtraction
+    void operator += (complexArray & c) {
+        add(* this, c, * this);
+    }
+    void operator -= (complexArray & c) {
+        sub(* this, c, * this);
+    }
+    complexArray operator + (complexArray & c) {
+        complexArray t(std::min(length, c.length));
+        add(* this, c, t);
+        return t;
+    }
+    complexArray operator - (complexArray & c) {
+        complexArray t(std::min(length, c.length));
+        sub(* this, c, t);
+        return t;
+    }
+    
+    // element-wise multiplication and division
+    void operator *= (complexArray & c) {
+        mul(* this, c, * this);
+    }
+    void operator /= (complexArray & c) {
+        div(* this, c, * this);
+    }
+    complexArray operator * (complexArray & c) {
+        complexArray t(std::min(length, c.length));
+        mul(* this, c, t);
+        return t;
+    }
+    complexArray operator / (complexArray & c) {
+        complexArray t(std::min(length, c.length));
+        div(* this, c, t);
+        return t;
+    }
+    
+    // scaling by one complex number, division takes one reciprocal total
+    void operator *= (complex c) {
+        double * __restrict a = r, * __restrict b = i;
+        for(int k = 0; k < length; k++){
+            double t = a[k];
+            a[k] = t * c.r - b[k] * c.i;
+            b[k] = t * c.i + b[k] * c.r;
+        }
+    }
+    void operator /= (complex c) {
+        * this *= complex(1.0, 0.0) / c;
+    }
+    
+    // conjugate in place
+    void conj () {
+        double * __restrict b = i;
+        for(int k = 0; k < length; k++)
+            b[k] = -b[k];
+    }
+    
+    // magnitudes into m
+    void mag (double * m) {
+        const double * __restrict a = r, * __restrict b = i;
+        for(int k = 0; k < length; k++)
+            m[k] = std::sqrt(a[k] * a[k] + b[k] * b[k]);
+    }
+    
+    // fused multiply accumulate, this += a * b
+    void fma (complexArray & a, complexArray & b) {
+        int n = std::min(length, std::min(a.length, b.length));
+        double * __restrict cr = r, * __restrict ci = i;
+        const double * __restrict ar = a.r, * __restrict ai = a.i, * __restrict br = b.r, * __restrict bi = b.i;
+        for(int k = 0; k < n; k++){
+            cr[k] += ar[k] * br[k] - ai[k] * bi[k];
+            ci[k] += ar[k] * bi[k] + ai[k] * br[k];
+        }
+    }
+    
+    // kernels writing into c, which may be a or b
+    static void add (complexArray & a, complexArray & b, complexArray & c) {
+        int n = std::min(c.length, std::min(a.length, b.length));
+        const double * ar = a.r, * ai = a.i, * br = b.r, * bi = b.i;
+        double * cr = c.r, * ci = c.i;
+        for(int k = 0; k < n; k++){
+            cr[k] = ar[k] + br[k];
+            ci[k] = ai[k] + bi[k];
+        }
+    }
+    static void sub (complexArray & a, complexArray & b, complexArray & c) {
+        int n = std::min(c.length, std::min(a.length, b.length));
+        const double * ar = a.r, * ai = a.i, * br = b.r, * bi = b.i;
+        double * cr = c.r, * ci = c.i;
+        for(int k = 0; k < n; k++){
+            cr[k] = ar[k] - br[k];
+            ci[k] = ai[k] - bi[k];
+        }
+    }
+    static void mul (complexArray & a, complexArray & b, complexArray & c) {
+        int n = std::min(c.length, std::min(a.length, b.length));
+        const double * ar = a.r, * ai = a.i, * br = b.r, * bi = b.i;
+        double * cr = c.r, * ci = c.i;
+        for(int k = 0; k < n; k++){
+            double x = ar[k] * br[k] - ai[k] * bi[k], y = ar[k] * bi[k] + ai[k] * br[k];
+            cr[k] = x;
+            ci[k] = y;
+        }
+    }
+    static void div (complexArray & a, complexArray & b, complexArray & c) {
+        int n = std::min(c.length, std::min(a.length, b.length));
+        const double * ar = a.r, * ai = a.i, * br = b.r, * bi = b.i;
+        double * cr = c.r, * ci = c.i;
+        for(int k = 0; k < n; k++){
+            double m = 1 / (br[k] * br[k] + bi[k] * bi[k]);
+            double x = (ar[k] * br[k] + ai[k] * bi[k]) * m, y = (ai[k] * br[k] - ar[k] * bi[k]) * m;
+            cr[k] = x;
+            ci[k] = y;
+        }
+    }
+    
+    // print
+    void print () {
+        for(int k = 0; k < length; k++)
+            std::cout << r[k] << ", " << i[k] << std::endl;
+    }
+};
+
+// quaternion structure
 struct quaternion {
     double r, i, j, k;
     
@@ -636,15 +1134,188 @@ struct quaternion {
         k -= q.k;
     }
     
-    // multiplication
+    // hamilton product
     quaternion operator * (quaternion q){
-        return quaternion();
+        return quaternion(r * q.r - i * q.i - j * q.j - k * q.k,
+                          r * q.i + i * q.r + j * q.k - k * q.j,
+                          r * q.j - i * q.k + j * q.r + k * q.i,
+                          r * q.k + i * q.j - j * q.i + k * q.r);
+    }
+    void operator *= (quaternion q){
+        * this = * this * q;
+    }
+    
+    // scaling
+    quaternion operator * (double s){
+        return quaternion(r * s, i * s, j * s, k * s);
+    }
+    void operator *= (double s){
+        r *= s;
+        i *= s;
+        j *= s;
+        k *= s;
+    }
+    
+    // division, multiplies by the inverse
+    quaternion operator / (quaternion q){
+        return * this * q.inverse();
+    }
+    void operator /= (quaternion q){
+        * this = * this * q.inverse();
+    }
+    
+    // dot product
+    double dot(quaternion q){
+        return r * q.r + i * q.i + j * q.j + k * q.k;
+    }
+    
+    // magnitude
+    double mag(){
+        return std::sqrt(r * r + i * i + j * j + k * k);
+    }
+    
+    // normalization
+    void norm(){
+        double m = 1 / std::sqrt(r * r + i * i + j * j + k * k);
+        r *= m;
+        i *= m;
+        j *= m;
+        k *= m;
     }
     
-    // TODO: finish multiplication, division(?), exponentiation(?)
+    // conjugate and inverse
+    quaternion conj(){
+        return quaternion(r, -i, -j, -k);
+    }
+    quaternion inverse(){
+        double m = 1 / (r * r + i * i + j * j + k * k);
+        return quaternion(r * m, -i * m, -j * m, -k * m);
+    }
+    
+    // rotation of angle t about an axis
+    quaternion rotation(vec3 a, double t){
+        a.norm();
+        double s = std::sin(t * 0.5);
+        return quaternion(std::cos(t * 0.5), a.x * s, a.y * s, a.z * s);
+    }
+    
+    // rotation matching an orthonormal rotation matrix
+    quaternion rotation(mat3 m){
+        double t = m.x.x + m.y.y + m.z.z, s;
+        if(t > 0.0){
+            s = 0.5 / std::sqrt(t + 1.0);
+            return quaternion(0.25 / s, (m.z.y - m.y.z) * s, (m.x.z - m.z.x) * s, (m.y.x - m.x.y) * s);
+        }
+        if(m.x.x > m.y.y && m.x.x > m.z.z){
+            s = 2.0 * std::sqrt(1.0 + m.x.x - m.y.y - m.z.z);
+            return quaternion((m.z.y - m.y.z) / s, 0.25 * s, (m.x.y + m.y.x) / s, (m.x.z + m.z.x) / s);
+        }
+        if(m.y.y > m.z.z){
+            s = 2.0 * std::sqrt(1.0 + m.y.y - m.x.x - m.z.z);
+            return quaternion((m.x.z - m.z.x) / s, (m.x.y + m.y.x) / s, 0.25 * s, (m.y.z + m.z.y) / s);
+        }
+        s = 2.0 * std::sqrt(1.0 + m.z.z - m.x.x - m.y.y);
+        return quaternion((m.y.x - m.x.y) / s, (m.x.z + m.z.x) / s, (m.y.z + m.z.y) / s, 0.25 * s);
+    }
+    
+    // axis and angle of this unit quaternion
+    void axisAngle(vec3 & a, double & t){
+        double s = std::sqrt(i * i + j * j + k * k);
+        t = 2.0 * std::atan2(s, r);
+        a = s > 0.0 ? vec3(i / s, j / s, k / s) : vec3(1.0, 0.0, 0.0);
+    }
+    
+    // rotation matrix of this unit quaternion
+    mat3 matrix(){
+        double xx = i * i, yy = j * j, zz = k * k, xy = i * j, xz = i * k, yz = j * k, rx = r * i, ry = r * j, rz = r * k;
+        return mat3(vec3(1.0 - 2.0 * (yy + zz), 2.0 * (xy - rz), 2.0 * (xz + ry)),
+                    vec3(2.0 * (xy + rz), 1.0 - 2.0 * (xx + zz), 2.0 * (yz - rx)),
+                    vec3(2.0 * (xz - ry), 2.0 * (yz + rx), 1.0 - 2.0 * (xx + yy)));
+    }
+    
+    // rotate a vector by this unit quaternion
+    vec3 rotate(vec3 v){
+        vec3 u = vec3(i, j, k), t = u.cross(v) * 2.0;
+        return v + t * r + u.cross(t);
+    }
     
+    // rotate n vectors, going through the matrix once for the whole array
+    void rotate(const vec3 * v, vec3 * out, int n){
+        mat3 m = matrix();
+        double a = m.x.x, b = m.x.y, c = m.x.z, d = m.y.x, e = m.y.y, f = m.y.z, g = m.z.x, h = m.z.y, l = m.z.z;
+        for(int p = 0; p < n; p++){
+            double x = v[p].x, y = v[p].y, z = v[p].z;
+            out[p].x = a * x + b * y + c * z;
+            out[p].y = d * x + e * y + f * z;
+            out[p].z = g * x + h * y + l * z;
+        }
+    }
+    
+    void print(){
+        std::cout << r << ", " << i << ", " << j << ", " << k << std::endl;
+    }
 };
 
+// normalized linear interpolation, along the shorter arc
+quaternion nlerp(quaternion a, quaternion b, double t){
+    double s = a.dot(b) < 0.0 ? -t : t;
+    quaternion q = a * (1.0 - t) + b * s;
+    q.norm();
+    return q;
+}
+
+// spherical linear interpolation, along the shorter arc
+quaternion slerp(quaternion a, quaternion b, double t){
+    double d = a.dot(b), s = 1.0;
+    if(d < 0.0){
+        d = -d;
+        s = -1.0;
+    }
+    // nearly parallel, nlerp is exact to double precision here
+    if(d > 0.9995)
+        return nlerp(a, b, t);
+    double w = std::acos(d), m = 1 / std::sin(w);
+    return a * (std::sin((1.0 - t) * w) * m) + b * (s * std::sin(t * w) * m);
+}
+
+// blend n pairs of rotations, each with its own weight
+void nlerp(const quaternion * a, const quaternion * b, const double * t, quaternion * out, int n){
+    for(int p = 0; p < n; p++){
+        double s = a[p].r * b[p].r + a[p].i * b[p].i + a[p].j * b[p].j + a[p].k * b[p].k < 0.0 ? -t[p] : t[p], u = 1.0 - t[p];
+        double r = a[p].r * u + b[p].r * s, i = a[p].i * u + b[p].i * s, j = a[p].j * u + b[p].j * s, k = a[p].k * u + b[p].k * s;
+        double m = 1 / std::sqrt(r * r + i * i + j * j + k * k);
+        out[p].r = r * m;
+        out[p].i = i * m;
+        out[p].j = j * m;
+        out[p].k = k * m;
+    }
+}
+void slerp(const quaternion * a, const quaternion * b, const double * t, quaternion * out, int n){
+    for(int p = 0; p < n; p++){
+        double d = a[p].r * b[p].r + a[p].i * b[p].i + a[p].j * b[p].j + a[p].k * b[p].k, s = 1.0;
+        if(d < 0.0){
+            d = -d;
+            s = -1.0;
+        }
+        double u, v;
+        if(d > 0.9995){
+            u = 1.0 - t[p];
+            v = s * t[p];
+        }
+        else{
+            double w = std::acos(d), m = 1 / std::sin(w);
+            u = std::sin((1.0 - t[p]) * w) * m;
+            v = s * std::sin(t[p] * w) * m;
+        }
+        double r = a[p].r * u + b[p].r * v, i = a[p].i * u + b[p].i * v, j = a[p].j * u + b[p].j * v, k = a[p].k * u + b[p].k * v;
+        double m = 1 / std::sqrt(r * r + i * i + j * j + k * k);
+        out[p].r = r * m;
+        out[p].i = i * m;
+        out[p].j = j * m;
+        out[p].k = k * m;
+    }
+}
+
 // ray structure
 struct ray {
     vec3 o, d;
@@ -659,10 +1330,12 @@ struct ray {
     
     // ray marching
     void march(double (*sdf) (vec3), double err, int max){
+        PROFILE_SCOPE("ray::march", 0, 0);
         double m;
         do{
             m = sdf(o + d * t);
             t += m;
+            PROFILE_WORK(0, 0, 1);
         }
         while(m > err && max-- > 0);
     }
@@ -710,134 +1383,523 @@ private:
     }
 };
 
-// generalized vector TODO: dot product, constructor / destructor
+// memory source for vector<T>
+class allocator {
+public:
+    virtual void * allocate (size_t bytes, size_t align) = 0;
+    virtual void deallocate (void * p, size_t bytes, size_t align) = 0;
+    virtual ~allocator () {}
+};
+
+// the global heap
+class heap : public allocator {
+public:
+    void * allocate (size_t bytes, size_t align) {
+        if(align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+            return ::operator new(bytes);
+        return ::operator new(bytes, std::align_val_t(align));
+    }
+    void deallocate (void * p, size_t, size_t align) {
+        if(align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+            ::operator delete(p);
+        else
+            ::operator delete(p, std::align_val_t(align));
+    }
+};
+allocator * globalHeap () {
+    static heap h;
+    return &h;
+}
+
+// allocator new vectors on this thread draw from
+allocator * & currentAllocator () {
+    thread_local allocator * a = globalHeap();
+    return a;
+}
+
+// routes this thread's vectors to a until the scope ends
+class allocScope {
+private:
+    allocator * previous;
+    
+public:
+    allocScope (allocator & a) {
+        previous = currentAllocator();
+        currentAllocator() = &a;
+    }
+    allocScope (const allocScope &) = delete;
+    ~allocScope () {
+        currentAllocator() = previous;
+    }
+};
+
+// bump pointer arena for one request or frame: deallocate does nothing
+// and release() hands everything back at once in O(1), keeping the
+// chunks for the next round. not thread safe, use one per thread
+class arena : public allocator {
+private:
+    struct chunk {
+        chunk * next;
+        size_t size;
+    };
+    allocator * upstream;
+    size_t chunkSize;
+    chunk * head = nullptr, * current = nullptr;
+    char * cursor = nullptr, * end = nullptr;
+    
+    // first usable byte of a chunk
+    static char * start (chunk * c) {
+        return reinterpret_cast<char *>(c) + sizeof(chunk);
+    }
+    
+public:
+    arena (size_t size = 1 << 20, allocator * up = globalHeap()) {
+        chunkSize = size;
+        upstream = up;
+    }
+    arena (const arena &) = delete;
+    ~arena () {
+        while(head){
+            chunk * c = head;
+            head = head->next;
+            upstream->deallocate(c, c->size, alignof(std::max_align_t));
+        }
+    }
+    
+    void * allocate (size_t bytes, size_t align) {
+        for(;;){
+            uintptr_t p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(static_cast<uintptr_t>(align) - 1);
+            if(cursor && p + bytes <= reinterpret_cast<uintptr_t>(end)){
+                cursor = reinterpret_cast<char *>(p + bytes);
+                return reinterpret_cast<void *>(p);
+            }
+            
+            // move on to the next kept chunk if it fits, else add one
+            chunk * c = current ? current->next : head;
+            if(!c || c->size < sizeof(chunk) + bytes + align){
+                size_t size = std::max(chunkSize, sizeof(chunk) + bytes + align);
+                chunk * n = static_cast<chunk *>(upstream->allocate(size, alignof(std::max_align_t)));
+                n->size = size;
+                n->next = c;
+                if(current)
+                    current->next = n;
+                else
+                    head = n;
+                c = n;
+            }
+            current = c;
+            cursor = start(c);
+            end = reinterpret_cast<char *>(c) + c->size;
+        }
+    }
+    void deallocate (void *, size_t, size_t) {}
+    
+    // forget every allocation, keeping the chunks
+    void release () {
+        current = nullptr;
+        cursor = end = nullptr;
+    }
+};
+
+// size class pool: blocks of 16 to 4096 bytes are recycled through
+// per class free lists and carved from an arena, larger ones go to the
+// upstream allocator. release() drops every block at once. not thread
+// safe, use one per thread
+class pool : public allocator {
+private:
+    static const int classes = 9;
+    struct block {
+        block * next;
+    };
+    struct large {
+        large * prev, * next;
+        size_t size, align;
+    };
+    allocator * upstream;
+    arena blocks;
+    block * lists[classes] = {};
+    large * big = nullptr;
+    
+    // smallest class holding bytes at the alignment
+    static int index (size_t bytes, size_t align) {
+        size_t s = std::max(bytes, align);
+        int c = 0;
+        for(size_t b = 16; b < s; b <<= 1)
+            c++;
+        return c;
+    }
+    static size_t header (size_t align) {
+        return (sizeof(large) + align - 1) / align * align;
+    }
+    
+public:
+    pool (size_t size = 1 << 20, allocator * up = globalHeap()) : blocks(size, up) {
+        upstream = up;
+    }
+    pool (const pool &) = delete;
+    ~pool () {
+        release();
+    }
+    
+    void * allocate (size_t bytes, size_t align) {
+        int c = index(bytes, align);
+        if(c < classes && align <= 64){
+            if(lists[c]){
+                block * b = lists[c];
+                lists[c] = b->next;
+                return b;
+            }
+            size_t s = static_cast<size_t>(16) << c;
+            return blocks.allocate(s, std::min(s, static_cast<size_t>(64)));
+        }
+        size_t a = std::max(align, alignof(large)), h = header(a);
+        char * p = static_cast<char *>(upstream->allocate(h + bytes, a));
+        large * l = reinterpret_cast<large *>(p + h - sizeof(large));
+        l->size = h + bytes;
+        l->align = a;
+        l->prev = nullptr;
+        l->next = big;
+        if(big)
+            big->prev = l;
+        big = l;
+        return p + h;
+    }
+    void deallocate (void * p, size_t bytes, size_t align) {
+        int c = index(bytes, align);
+        if(c < classes && align <= 64){
+            block * b = static_cast<block *>(p);
+            b->next = lists[c];
+            lists[c] = b;
+            return;
+        }
+        large * l = reinterpret_cast<large *>(static_cast<char *>(p) - sizeof(large));
+        if(l->prev)
+            l->prev->next = l->next;
+        else
+            big = l->next;
+        if(l->next)
+            l->next->prev = l->prev;
+        upstream->deallocate(static_cast<char *>(p) - header(l->align), l->size, l->align);
+    }
+    
+    // forget every block; large blocks go back upstream one by one
+    void release () {
+        for(int c = 0; c < classes; c++)
+            lists[c] = nullptr;
+        blocks.release();
+        while(big){
+            large * l = big;
+            big = big->next;
+            upstream->deallocate(reinterpret_cast<char *>(l) + sizeof(large) - header(l->align), l->size, l->align);
+        }
+    }
+};
+
+// raises the alignment of every allocation to a boundary, 32 or 64
+// bytes keeps SIMD loads from splitting cache lines
+class aligned : public allocator {
+private:
+    size_t boundary;
+    allocator * upstream;
+    
+public:
+    aligned (size_t b = 64, allocator * up = globalHeap()) {
+        boundary = b;
+        upstream = up;
+    }
+    
+    void * allocate (size_t bytes, size_t align) {
+        return upstream->allocate(bytes, std::max(align, boundary));
+    }
+    void deallocate (void * p, size_t bytes, size_t align) {
+        upstream->deallocate(p, bytes, std::max(align, boundary));
+    }
+};
+
+// huge page backed storage for very large buffers. allocations of at
+// least threshold bytes are mapped straight from the kernel, first from
+// the MAP_HUGETLB pool and failing that as 2MB aligned ordinary pages
+// marked for transparent huge pages. smaller ones, everything on
+// systems without mmap, and large ones the kernel refuses go to the
+// upstream allocator
+class hugePages : public allocator {
+private:
+    size_t threshold;
+    allocator * upstream;
+    
+    static size_t span (size_t bytes) {
+        return (bytes + page - 1) / page * page;
+    }
+    
+    // step for upstream blocks standing in for a mapping
+    static size_t step (size_t align) {
+        return std::max(align, alignof(std::max_align_t));
+    }
+    
+public:
+    static constexpr size_t page = 2 << 20;
+    
+    // allocations that got explicit huge pages, ones that fell back to
+    // transparent pages, and ones that went upstream; atomic since one
+    // hugePages may serve several threads
+    std::atomic<int> explicitPages{0}, transparentPages{0}, upstreamPages{0};
+    
+    hugePages (size_t t = page, allocator * up = globalHeap()) {
+        threshold = t;
+        upstream = up;
+    }
+    
+    void * allocate (size_t bytes, size_t align) {
+#if defined(__unix__) || defined(__APPLE__)
+        if(bytes >= threshold && align < page){
+            size_t n = span(bytes);
+            void * p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+            p = mmap(nullptr, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if(p != MAP_FAILED){
+                explicitPages++;
+                return p;
+            }
+#endif
+            // over map by a page and trim the ends to land on a boundary
+            char * m = static_cast<char *>(mmap(nullptr, n + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            if(m == MAP_FAILED){
+                // take it from upstream, stepped off the page boundary so
+                // deallocate can tell it from a mapping, with the block
+                // start stored just before it
+                size_t s = step(align);
+                char * q = static_cast<char *>(upstream->allocate(bytes + 2 * s, s)), * r = q + s;
+                if(reinterpret_cast<uintptr_t>(r) % page == 0)
+                    r += s;
+                reinterpret_cast<char **>(r)[-1] = q;
+                upstreamPages++;
+                return r;
+            }
+            char * a = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(m) + page - 1) & ~(static_cast<uintptr_t>(page) - 1));
+            if(a > m)
+                munmap(m, a - m);
+            if(a + n < m + n + page)
+                munmap(a + n, m + n + page - (a + n));
+#ifdef MADV_HUGEPAGE
+            madvise(a, n, MADV_HUGEPAGE);
+#endif
+            transparentPages++;
+            return a;
+        }
+#endif
+        return upstream->allocate(bytes, align);
+    }
+    void deallocate (void * p, size_t bytes, size_t align) {
+#if defined(__unix__) || defined(__APPLE__)
+        if(bytes >= threshold && align < page){
+            if(reinterpret_cast<uintptr_t>(p) % page){
+                size_t s = step(align);
+                upstream->deallocate(reinterpret_cast<char **>(p)[-1], bytes + 2 * s, s);
+            }
+            else
+                munmap(p, span(bytes));
+            return;
+        }
+#endif
+        upstream->deallocate(p, bytes, align);
+    }
+};
+
+// generalized vector TODO: dot product
 template <typename T>
 class vector{
 
 private:
-    int length;
+    int length, capacity;
     T * elements = nullptr;
+    allocator * alloc;
+    
+    // raw storage for n elements, constructed by the caller
+    T * claim (int n) {
+        PROFILE_COUNT("vector::allocate", 0, sizeof(T) * (n ? n : 1));
+        return static_cast<T *>(alloc->allocate(sizeof(T) * (n ? n : 1), alignof(T)));
+    }
+    void drop (T * e, int n, int c) {
+        if(!e)
+            return;
+        for(int i = 0; i < n; i++)
+            e[i].~T();
+        alloc->deallocate(e, sizeof(T) * (c ? c : 1), alignof(T));
+    }
+    
+    // moves the elements into storage for c of them
+    void grow (int c) {
+        T * t = claim(c);
+        for(int i = 0; i < length; i++)
+            new (t + i) T(elements[i]);
+        drop(elements, length, capacity);
+        elements = t;
+        capacity = c;
+    }
     
 public:
-    // 'structors
-    vector<T> (int l = 1) {
-        length = l;
-        elements = new T[l];
-        std::cout << "why" << std::endl;
+    // 'structors, storage comes from a or else this thread's allocator
+    vector<T> (int l = 1, allocator * a = nullptr) {
+        alloc = a ? a : currentAllocator();
+        length = capacity = l;
+        elements = claim(l);
+        for(int i = 0; i < l; i++)
+            new (elements + i) T();
     }
     vector<T> (const vector<T> & v){
-        length = v.length;
-        elements = new T[length];
+        alloc = currentAllocator();
+        length = capacity = v.length;
+        elements = claim(length);
         for(int i = 0; i < length; i++)
-            elements[i] = v.elements[i];
-        std::cout << "what how?" << std::endl;
+            new (elements + i) T(v.elements[i]);
+    }
+    vector<T> (vector<T> && v){
+        alloc = v.alloc;
+        length = v.length;
+        capacity = v.capacity;
+        elements = v.elements;
+        v.elements = nullptr;
+        v.length = v.capacity = 0;
     }
     ~vector<T> () {
-        delete [] elements;
-        std::cout << "oh cool" << std::endl;
+        if(elements)
+            drop(elements, length, capacity);
     }
     
     // get length
-    int len () {
+    int len () const {
         return length;
     }
     
+    // allocator the storage comes from
+    allocator * source () {
+        return alloc;
+    }
+    
+    // contiguous storage
+    T * data () {
+        return elements;
+    }
+    const T * data () const {
+        return elements;
+    }
+    
     // read and write element
     T & operator [] (int i) {
         return elements[i];
     }
     
-    // copy assignment
-    vector<T> operator = (vector<T> v) {
-        delete [] elements;
-        length = v.len();
-        elements = new T[length];
-        for(int i = 0; i < length; i++)
-            elements[i] = v[i];
+    // copy assignment, reusing the storage when it is big enough
+    vector<T> & operator = (const vector<T> & v) {
+        if(this == &v)
+            return * this;
+        if(capacity < v.length){
+            drop(elements, length, capacity);
+            capacity = v.length;
+            elements = claim(capacity);
+            length = 0;
+        }
+        for(int i = 0; i < v.length; i++){
+            if(i < length)
+                elements[i] = v.elements[i];
+            else
+                new (elements + i) T(v.elements[i]);
+        }
+        for(int i = v.length; i < length; i++)
+            elements[i].~T();
+        length = v.length;
         return * this;
     }
     
     // vector addition
-    vector<T> operator + (vector<T> v) {
-        vector<T> t (std::min(length, v.len()));
+    vector<T> operator + (const vector<T> & v) {
+        PROFILE_SCOPE("vector::operator+", std::min(length, v.length), 0);
+        vector<T> t (std::min(length, v.length));
         for(int i = 0; i < t.len(); i++){
-            t[i] = elements[i] + v[i];
+            t[i] = elements[i] + v.elements[i];
         }
         return t;
     }
-    void operator += (vector<T> v) {
+    void operator += (const vector<T> & v) {
+        PROFILE_SCOPE("vector::operator+=", length, 0);
         for(int i = 0; i < length; i++){
-            elements[i] += v[i];
+            elements[i] += v.elements[i];
         }
     }
     
     // vector subtraction
-    vector<T> operator - (vector<T> v) {
-        vector<T> t(std::min(length, v.len()));
+    vector<T> operator - (const vector<T> & v) {
+        PROFILE_SCOPE("vector::operator-", std::min(length, v.length), 0);
+        vector<T> t(std::min(length, v.length));
         for(int i = 0; i < t.len(); i++){
-            t[i] = elements[i] - v[i];
+            t[i] = elements[i] - v.elements[i];
         }
         return t;
     }
-    void operator -= (vector<T> v) {
+    void operator -= (const vector<T> & v) {
+        PROFILE_SCOPE("vector::operator-=", length, 0);
         for(int i = 0; i < length; i++){
-            elements[i] -= v[i];
+            elements[i] -= v.elements[i];
         }
     }
     
     // vector hadamard product
-    vector<T> operator * (vector<T> v) {
-        vector<T> t(std::min(length, v.len()));
+    vector<T> operator * (const vector<T> & v) {
+        PROFILE_SCOPE("vector::operator*", std::min(length, v.length), 0);
+        vector<T> t(std::min(length, v.length));
         for(int i = 0; i < t.len(); i++){
-            t[i] = elements[i] * v[i];
+            t[i] = elements[i] * v.elements[i];
         }
         return t;
     }
-    void operator *= (vector<T> v) {
+    void operator *= (const vector<T> & v) {
+        PROFILE_SCOPE("vector::operator*=", length, 0);
         for(int i = 0; i < length; i++){
-            elements[i] *= v[i];
+            elements[i] *= v.elements[i];
         }
     }
     
-    // vector dot product
-    T operator & (vector<T> v) {
-        T t = 0;
-        int m = std::min(length, v.len());
-        for(int i = 0; i < m; i++)
-            t += elements[i] * v[i];
-        return t;
+    // vector dot product, four accumulators so the adds overlap;
+    // reduce.h has compensated and multithreaded versions
+    T operator & (const vector<T> & v) {
+        PROFILE_SCOPE("vector::operator&", 2 * std::min(length, v.length), 0);
+        T t[4] = {0, 0, 0, 0};
+        int m = std::min(length, v.length), i = 0;
+        for(; i + 4 <= m; i += 4){
+            t[0] += elements[i] * v.elements[i];
+            t[1] += elements[i + 1] * v.elements[i + 1];
+            t[2] += elements[i + 2] * v.elements[i + 2];
+            t[3] += elements[i + 3] * v.elements[i + 3];
+        }
+        for(; i < m; i++)
+            t[0] += elements[i] * v.elements[i];
+        return (t[0] + t[1]) + (t[2] + t[3]);
     }
     
     // reserve space
     void reserve (int l) {
+        if(l > capacity)
+            grow(l);
+        for(int i = length; i < l; i++)
+            new (elements + i) T();
+        for(int i = l; i < length; i++)
+            elements[i].~T();
         length = l;
-        T * t = new T[length];
-        for(int i = 0; i < length; i++)
-            t[i] = elements[i];
-        delete [] elements;
-        elements = t;
     }
     
     // push element
     void push (T element) {
-        T * t = new T[length + 1];
-        for(int i = 0; i < length; i++)
-            t[i] = elements[i];
-        t[length] = element;
-        delete [] elements;
-        elements = t;
+        if(length == capacity)
+            grow(capacity ? 2 * capacity : 4);
+        new (elements + length) T(element);
         length++;
     }
     
     // pop element
     T pop () {
         length--;
-        T * t = new T[length];
-        for(int i = 0; i < length; i++)
-            t[i] = elements[i];
         T m = elements[length];
-        delete [] elements;
-        elements = t;
+        elements[length].~T();
         return m;
     }
     
@@ -854,7 +1916,126 @@ public:
     }
 };
 
-// generalized matrix TODO: all
+// generalized matrix, dense and row major
+template <typename T>
+class matrix{
+
+private:
+    int rows, cols;
+    vector<T> elements;
+    
+public:
+    // 'structors, r x c zeros with storage from a or else this thread's
+    // allocator
+    matrix<T> (int r = 0, int c = 0, allocator * a = nullptr) : rows(r), cols(c), elements(r * c, a) {}
+    
+    // n x n identity
+    static matrix<T> identity (int n) {
+        matrix<T> m(n, n);
+        for(int i = 0; i < n; i++)
+            m(i, i) = 1;
+        return m;
+    }
+    
+    // get dimensions
+    int height () const {
+        return rows;
+    }
+    int width () const {
+        return cols;
+    }
+    
+    // read and write element
+    T & operator () (int r, int c) {
+        return elements.data()[static_cast<size_t>(r) * cols + c];
+    }
+    const T & operator () (int r, int c) const {
+        return elements.data()[static_cast<size_t>(r) * cols + c];
+    }
+    
+    // contiguous storage, and the start of row r
+    T * data () {
+        return elements.data();
+    }
+    const T * data () const {
+        return elements.data();
+    }
+    T * row (int r) {
+        return data() + static_cast<size_t>(r) * cols;
+    }
+    const T * row (int r) const {
+        return data() + static_cast<size_t>(r) * cols;
+    }
+    
+    // transpose, copied in square tiles so both sides stay in cache
+    matrix<T> transpose () const {
+        PROFILE_SCOPE("matrix::transpose", 0, 0);
+        matrix<T> t(cols, rows);
+        for(int i0 = 0; i0 < rows; i0 += 32)
+            for(int j0 = 0; j0 < cols; j0 += 32)
+                for(int i = i0; i < std::min(rows, i0 + 32); i++)
+                    for(int j = j0; j < std::min(cols, j0 + 32); j++)
+                        t(j, i) = (* this)(i, j);
+        return t;
+    }
+    
+    // matrix addition and subtraction
+    matrix<T> operator + (const matrix<T> & m) const {
+        PROFILE_SCOPE("matrix::operator+", static_cast<uint64_t>(rows) * cols, 0);
+        matrix<T> t(rows, cols);
+        for(size_t i = 0; i < static_cast<size_t>(rows) * cols; i++)
+            t.data()[i] = data()[i] + m.data()[i];
+        return t;
+    }
+    matrix<T> operator - (const matrix<T> & m) const {
+        PROFILE_SCOPE("matrix::operator-", static_cast<uint64_t>(rows) * cols, 0);
+        matrix<T> t(rows, cols);
+        for(size_t i = 0; i < static_cast<size_t>(rows) * cols; i++)
+            t.data()[i] = data()[i] - m.data()[i];
+        return t;
+    }
+    
+    // matrix vector product
+    vector<T> operator * (const vector<T> & v) const {
+        PROFILE_SCOPE("matrix::operator*", 2 * static_cast<uint64_t>(rows) * cols, 0);
+        vector<T> t(rows);
+        for(int i = 0; i < rows; i++){
+            const T * r = row(i);
+            T s = 0;
+            for(int j = 0; j < cols; j++)
+                s += r[j] * v.data()[j];
+            t[i] = s;
+        }
+        return t;
+    }
+    
+    // matrix product, a row of the result at a time so every inner loop
+    // runs along rows; linalg.h has a blocked multithreaded version
+    matrix<T> operator * (const matrix<T> & m) const {
+        PROFILE_SCOPE("matrix::operator*", 2 * static_cast<uint64_t>(rows) * cols * m.cols, 0);
+        matrix<T> t(rows, m.cols);
+        for(int i = 0; i < rows; i++){
+            T * o = t.row(i);
+            for(int k = 0; k < cols; k++){
+                T a = (* this)(i, k);
+                const T * b = m.row(k);
+                for(int j = 0; j < m.cols; j++)
+                    o[j] += a * b[j];
+            }
+        }
+        return t;
+    }
+    
+    // print
+    void print () {
+        for(int i = 0; i < rows; i++){
+            std::cout << (i ? " [" : "[[");
+            for(int j = 0; j < cols; j++)
+                std::cout << (* this)(i, j) << (j == cols - 1 ? "]" : ", ");
+            std::cout << (i == rows - 1 ? "]" : "") << std::endl;
+        }
+    }
+};
 
 // generalized tensor TODO: all
 
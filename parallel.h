@@ -0,0 +1,151 @@
+//
+//  parallel.h
+//  VecLib
+//
+// A small persistent thread pool and the parallel loop built on it.
+// Workers are started once and then sleep between jobs, so splitting
+// a loop costs a wake up instead of a thread launch. The calling
+// thread always takes part, and loops started from inside a worker
+// just run serially instead of waiting on the pool they are part of.
+//
+
+#ifndef parallel_h
+#define parallel_h
+
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+class threadPool {
+private:
+    std::vector<std::thread> workers;
+    std::mutex lock, submit;
+    std::condition_variable wake, finished;
+    std::function<void(int)> job;
+    std::atomic<int> next;
+    int chunks = 0, busy = 0;
+    unsigned generation = 0;
+    bool stop = false, open = false;
+
+    // set on pool threads and while the caller is helping with a job
+    static bool & inside () {
+        thread_local bool b = false;
+        return b;
+    }
+
+    // takes chunks until there are none left
+    void drain () {
+        for(int c = next++; c < chunks; c = next++)
+            job(c);
+    }
+
+    void work () {
+        inside() = true;
+        unsigned seen = 0;
+        for(;;){
+            {
+                std::unique_lock<std::mutex> l(lock);
+                wake.wait(l, [&]{ return stop || generation != seen; });
+                if(stop)
+                    return;
+                seen = generation;
+                // too late to join, the caller has already finished it
+                if(!open)
+                    continue;
+                busy++;
+            }
+            drain();
+            std::lock_guard<std::mutex> l(lock);
+            if(--busy == 0)
+                finished.notify_all();
+        }
+    }
+
+public:
+    threadPool (int n = 0) {
+        if(n <= 0)
+            n = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        for(int i = 1; i < n; i++)
+            workers.emplace_back([this]{ work(); });
+    }
+    threadPool (const threadPool &) = delete;
+    ~threadPool () {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            stop = true;
+        }
+        wake.notify_all();
+        for(std::thread & t : workers)
+            t.join();
+    }
+
+    // threads a job can run on, the caller included
+    int size () {
+        return static_cast<int>(workers.size()) + 1;
+    }
+
+    // runs f(c) for every c in [0, n) and returns once all are done
+    void run (int n, std::function<void(int)> f) {
+        if(n <= 0)
+            return;
+        if(n == 1 || workers.empty() || inside()){
+            for(int c = 0; c < n; c++)
+                f(c);
+            return;
+        }
+        std::lock_guard<std::mutex> s(submit);
+        {
+            std::lock_guard<std::mutex> l(lock);
+            job = f;
+            chunks = n;
+            next = 0;
+            generation++;
+            open = true;
+        }
+        wake.notify_all();
+        inside() = true;
+        drain();
+        inside() = false;
+        std::unique_lock<std::mutex> l(lock);
+        open = false;
+        finished.wait(l, [&]{ return busy == 0; });
+        job = nullptr;
+    }
+};
+
+// pool shared by the library, one thread per core
+threadPool & sharedPool () {
+    static threadPool p;
+    return p;
+}
+
+// threads parallel loops may use, 0 means all of the shared pool
+int & threadLimit () {
+    static int n = 0;
+    return n;
+}
+int threadCount () {
+    int n = sharedPool().size(), l = threadLimit();
+    return l > 0 && l < n ? l : n;
+}
+
+// runs f(begin, end) over [0, n) in contiguous ranges of at least
+// grain items, at most one range per thread
+template <typename F>
+void parallelFor (int n, int grain, F f) {
+    int t = std::min(threadCount(), std::max(1, n / std::max(1, grain)));
+    if(t <= 1){
+        if(n > 0)
+            f(0, n);
+        return;
+    }
+    sharedPool().run(t, [&](int c){
+        f(static_cast<int>(static_cast<long>(n) * c / t), static_cast<int>(static_cast<long>(n) * (c + 1) / t));
+    });
+}
+
+#endif /* parallel_h */
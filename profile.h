@@ -0,0 +1,267 @@
+//
+//  profile.h
+//  VecLib
+//
+// Optional instrumentation of the library's hot paths. Built with
+// VECLIB_PROFILE defined, every probed function counts its calls and
+// adds its running time in nanoseconds and clock cycles, an estimate of
+// its floating point operations, the bytes it allocates and, for loops
+// like ray marching, the items of work done. Without VECLIB_PROFILE the
+// probes expand to nothing and their arguments are never evaluated.
+// Scoped probes double as the operations of the allocation tracer in
+// trace.h, which is switched on by VECLIB_TRACE on its own.
+//
+// Counters live in a block per thread and only that thread writes them,
+// with plain relaxed loads and stores, so a probe never contends with
+// another thread. Reading a snapshot sums the blocks of every thread
+// that has ever run a probe, without stopping any of them. Snapshots
+// can be written out as JSON or in the Prometheus text format.
+//
+
+#ifndef profile_h
+#define profile_h
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <ostream>
+#include "trace.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// most distinct probes, any past this are counted together as "other"
+#define PROFILE_SITES 512
+
+// totals of one probe
+struct profileEntry {
+    std::string name;
+    uint64_t calls, ns, cycles, flops, bytes, items;
+};
+
+#ifdef VECLIB_PROFILE
+
+// cycle counter where there is one, else 0
+uint64_t profileCycles(){
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t t;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(t));
+    return t;
+#else
+    return 0;
+#endif
+}
+uint64_t profileNanos(){
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// counters of one probe in one thread, written by that thread only
+struct profileCounter {
+    std::atomic<uint64_t> field[6];
+
+    void add(int f, uint64_t v){
+        field[f].store(field[f].load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    }
+};
+enum profileField {PROFILE_CALLS, PROFILE_NS, PROFILE_CYCLES, PROFILE_FLOPS, PROFILE_BYTES, PROFILE_ITEMS};
+
+class profileRegistry {
+public:
+    profileRegistry(){
+        names.push_back("other");
+    }
+
+    // number of a probe name, one call per probe site; sites sharing a
+    // name, like one probe in every instance of a template, share it
+    int site(const char * name){
+        std::lock_guard<std::mutex> l(lock);
+        for(size_t s = 1; s < names.size(); s++)
+            if(names[s] == name)
+                return static_cast<int>(s);
+        if(names.size() >= PROFILE_SITES)
+            return 0;
+        names.push_back(name);
+        return static_cast<int>(names.size()) - 1;
+    }
+
+    // this thread's counters, made on first use and kept after it exits
+    profileCounter * local(){
+        thread_local profileCounter * block = nullptr;
+        if(!block){
+            std::unique_ptr<profileCounter[]> b(new profileCounter[PROFILE_SITES]);
+            for(int s = 0; s < PROFILE_SITES; s++)
+                for(int f = 0; f < 6; f++)
+                    b[s].field[f].store(0, std::memory_order_relaxed);
+            block = b.get();
+            std::lock_guard<std::mutex> l(lock);
+            threads.push_back(std::move(b));
+        }
+        return block;
+    }
+
+    // totals since the last reset, probes never reached left out
+    std::vector<profileEntry> snapshot(){
+        std::lock_guard<std::mutex> l(lock);
+        std::vector<profileEntry> out;
+        for(size_t s = 0; s < names.size(); s++){
+            uint64_t v[6];
+            total(static_cast<int>(s), v);
+            profileEntry e = {names[s], v[0], v[1], v[2], v[3], v[4], v[5]};
+            if(s < base.size()){
+                e.calls -= base[s].calls;
+                e.ns -= base[s].ns;
+                e.cycles -= base[s].cycles;
+                e.flops -= base[s].flops;
+                e.bytes -= base[s].bytes;
+                e.items -= base[s].items;
+            }
+            if(e.calls || e.items)
+                out.push_back(e);
+        }
+        return out;
+    }
+
+    // starts the totals again from zero, without touching the counters
+    // the threads write
+    void reset(){
+        std::lock_guard<std::mutex> l(lock);
+        base.clear();
+        for(size_t s = 0; s < names.size(); s++){
+            uint64_t v[6];
+            total(static_cast<int>(s), v);
+            base.push_back(profileEntry {names[s], v[0], v[1], v[2], v[3], v[4], v[5]});
+        }
+    }
+
+private:
+    std::mutex lock;
+    std::vector<std::string> names;
+    std::vector<std::unique_ptr<profileCounter[]>> threads;
+    std::vector<profileEntry> base;
+
+    void total(int s, uint64_t * v){
+        for(int f = 0; f < 6; f++)
+            v[f] = 0;
+        for(auto & t : threads)
+            for(int f = 0; f < 6; f++)
+                v[f] += t[s].field[f].load(std::memory_order_relaxed);
+    }
+};
+
+profileRegistry & profiler(){
+    static profileRegistry r;
+    return r;
+}
+
+// times the scope it lives in and counts one call
+class profileScope {
+public:
+    profileScope(int site, uint64_t flops, uint64_t bytes) : c(profiler().local()[site]) {
+        c.add(PROFILE_FLOPS, flops);
+        c.add(PROFILE_BYTES, bytes);
+        ns = profileNanos();
+        cycles = profileCycles();
+    }
+    ~profileScope(){
+        c.add(PROFILE_CYCLES, profileCycles() - cycles);
+        c.add(PROFILE_NS, profileNanos() - ns);
+        c.add(PROFILE_CALLS, 1);
+    }
+
+    // more work found out after the scope started
+    void work(uint64_t flops, uint64_t bytes, uint64_t items){
+        c.add(PROFILE_FLOPS, flops);
+        c.add(PROFILE_BYTES, bytes);
+        c.add(PROFILE_ITEMS, items);
+    }
+
+private:
+    profileCounter & c;
+    uint64_t ns, cycles;
+};
+
+// counts a call with no timing, for operations too small to time
+void profileCount(int site, uint64_t flops, uint64_t bytes){
+    profileCounter & c = profiler().local()[site];
+    c.add(PROFILE_CALLS, 1);
+    c.add(PROFILE_FLOPS, flops);
+    c.add(PROFILE_BYTES, bytes);
+}
+
+std::vector<profileEntry> profileSnapshot(){
+    return profiler().snapshot();
+}
+void profileReset(){
+    profiler().reset();
+}
+
+// one scope per block, the site registered on its first run; it is
+// also a frame for allocation tracing
+#define PROFILE_SCOPE(name, flops, bytes) \
+    static const int profileSite = profiler().site(name); \
+    profileScope profileProbe(profileSite, (flops), (bytes)); \
+    TRACE_SCOPE(name)
+#define PROFILE_WORK(flops, bytes, items) profileProbe.work((flops), (bytes), (items))
+#define PROFILE_COUNT(name, flops, bytes) \
+    do{ \
+        static const int profileSite = profiler().site(name); \
+        profileCount(profileSite, (flops), (bytes)); \
+    } while(0)
+
+#else
+
+std::vector<profileEntry> profileSnapshot(){
+    return std::vector<profileEntry>();
+}
+void profileReset(){
+}
+
+#define PROFILE_SCOPE(name, flops, bytes) TRACE_SCOPE(name)
+#define PROFILE_WORK(flops, bytes, items)
+#define PROFILE_COUNT(name, flops, bytes)
+
+#endif
+
+// snapshot as a JSON array of probes
+void profileJson(std::ostream & out){
+    std::vector<profileEntry> s = profileSnapshot();
+    out << "[";
+    for(size_t i = 0; i < s.size(); i++){
+        out << (i ? ",\n " : "\n ") << "{\"name\": \"";
+        for(char c : s[i].name){
+            if(c == '"' || c == '\\')
+                out << '\\';
+            out << c;
+        }
+        out << "\", \"calls\": " << s[i].calls << ", \"ns\": " << s[i].ns << ", \"cycles\": " << s[i].cycles;
+        out << ", \"flops\": " << s[i].flops << ", \"bytes\": " << s[i].bytes << ", \"items\": " << s[i].items << "}";
+    }
+    out << (s.empty() ? "]\n" : "\n]\n");
+}
+
+// snapshot in the Prometheus text format, one counter family per field
+void profilePrometheus(std::ostream & out){
+    std::vector<profileEntry> s = profileSnapshot();
+    const char * family[6] = {"calls", "nanoseconds", "cycles", "flops", "bytes", "items"};
+    for(int f = 0; f < 6; f++){
+        out << "# TYPE veclib_" << family[f] << "_total counter\n";
+        for(const profileEntry & e : s){
+            uint64_t v[6] = {e.calls, e.ns, e.cycles, e.flops, e.bytes, e.items};
+            out << "veclib_" << family[f] << "_total{probe=\"";
+            for(char c : e.name){
+                if(c == '"' || c == '\\')
+                    out << '\\';
+                out << (c == '\n' ? ' ' : c);
+            }
+            out << "\"} " << v[f] << "\n";
+        }
+    }
+}
+
+#endif /* profile_h */
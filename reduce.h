@@ -0,0 +1,187 @@
+//
+//  reduce.h
+//  VecLib
+//
+// Reductions over vector<T>: sum, dot product, norm, minimum and
+// maximum with their indices. Sums run several independent
+// accumulators so the adds overlap, and can be pairwise or Kahan
+// compensated to keep long float vectors accurate. Large inputs are
+// split across the shared thread pool. In deterministic mode the
+// input is always cut into the same fixed blocks and the block
+// results are combined in the same order, so the answer is bit for
+// bit the same whatever the thread count.
+//
+
+#ifndef reduce_h
+#define reduce_h
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <iostream>
+#include "math.h"
+#include "parallel.h"
+
+// block size of deterministic reductions, and the size an input needs
+// before it is worth handing to other threads
+#define REDUCE_BLOCK 4096
+#define REDUCE_PARALLEL (1 << 16)
+
+// how sums accumulate
+enum summation {
+    SUM_FAST,       // eight accumulators, added up at the end
+    SUM_PAIRWISE,   // recursive halving down to eight accumulator runs
+    SUM_KAHAN       // four compensated accumulators
+};
+
+// reduction options
+struct reduction {
+    int method;
+    bool deterministic;
+
+    // constructor
+    reduction(int m = SUM_PAIRWISE, bool d = true){
+        method = m;
+        deterministic = d;
+    }
+};
+
+// sum of f(i) over [b, e)
+template <typename T, typename F>
+T sumRange (F & f, int b, int e, int method) {
+    if(method == SUM_KAHAN){
+        T s[4] = {}, c[4] = {};
+        int i = b;
+        for(; i + 4 <= e; i += 4){
+            for(int k = 0; k < 4; k++){
+                T y = f(i + k) - c[k], t = s[k] + y;
+                c[k] = (t - s[k]) - y;
+                s[k] = t;
+            }
+        }
+        for(; i < e; i++){
+            T y = f(i) - c[0], t = s[0] + y;
+            c[0] = (t - s[0]) - y;
+            s[0] = t;
+        }
+        T sum = s[0], comp = c[0];
+        for(int k = 1; k < 4; k++){
+            T y = s[k] - c[k] - comp, t = sum + y;
+            comp = (t - sum) - y;
+            sum = t;
+        }
+        return sum;
+    }
+    if(method == SUM_PAIRWISE && e - b > 256){
+        int m = b + ((e - b) / 2 & ~7);
+        return sumRange<T>(f, b, m, method) + sumRange<T>(f, m, e, method);
+    }
+    T s[8] = {};
+    int i = b;
+    for(; i + 8 <= e; i += 8)
+        for(int k = 0; k < 8; k++)
+            s[k] += f(i + k);
+    for(; i < e; i++)
+        s[0] += f(i);
+    return ((s[0] + s[1]) + (s[2] + s[3])) + ((s[4] + s[5]) + (s[6] + s[7]));
+}
+
+// sum of f(i) over [0, n), split over blocks or threads
+template <typename T, typename F>
+T reduceSum (int n, F f, reduction r) {
+    std::vector<T> part;
+    if(r.deterministic){
+        int blocks = (n + REDUCE_BLOCK - 1) / REDUCE_BLOCK;
+        if(blocks <= 1)
+            return sumRange<T>(f, 0, n, r.method);
+        part.resize(blocks);
+        parallelFor(blocks, REDUCE_PARALLEL / REDUCE_BLOCK, [&](int b, int e){
+            for(int k = b; k < e; k++)
+                part[k] = sumRange<T>(f, k * REDUCE_BLOCK, std::min(n, (k + 1) * REDUCE_BLOCK), r.method);
+        });
+    }
+    else{
+        int t = std::min(threadCount(), n / REDUCE_PARALLEL);
+        if(t <= 1)
+            return sumRange<T>(f, 0, n, r.method);
+        part.resize(t);
+        sharedPool().run(t, [&](int c){
+            part[c] = sumRange<T>(f, static_cast<int>(static_cast<long>(n) * c / t), static_cast<int>(static_cast<long>(n) * (c + 1) / t), r.method);
+        });
+    }
+    auto g = [&](int i){ return part[i]; };
+    return sumRange<T>(g, 0, static_cast<int>(part.size()), r.method);
+}
+
+// index of the smallest (less) or largest element, first one on ties
+template <typename T>
+int reduceArg (const T * a, int n, bool less) {
+    if(n <= 0)
+        return -1;
+    auto scan = [&](int b, int e){
+        int m = b;
+        for(int i = b + 1; i < e; i++)
+            if(less ? a[i] < a[m] : a[m] < a[i])
+                m = i;
+        return m;
+    };
+    int blocks = (n + REDUCE_BLOCK - 1) / REDUCE_BLOCK;
+    if(n < REDUCE_PARALLEL)
+        return scan(0, n);
+    std::vector<int> part(blocks);
+    parallelFor(blocks, REDUCE_PARALLEL / REDUCE_BLOCK, [&](int b, int e){
+        for(int k = b; k < e; k++)
+            part[k] = scan(k * REDUCE_BLOCK, std::min(n, (k + 1) * REDUCE_BLOCK));
+    });
+    int m = part[0];
+    for(int k = 1; k < blocks; k++)
+        if(less ? a[part[k]] < a[m] : a[m] < a[part[k]])
+            m = part[k];
+    return m;
+}
+
+// sum of the elements
+template <typename T>
+T sum (const vector<T> & v, reduction r = reduction()) {
+    const T * a = v.data();
+    return reduceSum<T>(v.len(), [a](int i){ return a[i]; }, r);
+}
+
+// dot product over the shorter length
+template <typename T>
+T dot (const vector<T> & u, const vector<T> & v, reduction r = reduction()) {
+    const T * a = u.data(), * b = v.data();
+    return reduceSum<T>(std::min(u.len(), v.len()), [a, b](int i){ return a[i] * b[i]; }, r);
+}
+
+// euclidean norm
+template <typename T>
+T norm (const vector<T> & v, reduction r = reduction()) {
+    const T * a = v.data();
+    return static_cast<T>(std::sqrt(reduceSum<T>(v.len(), [a](int i){ return a[i] * a[i]; }, r)));
+}
+
+// positions of the smallest and largest elements, -1 when empty
+template <typename T>
+int argmin (const vector<T> & v) {
+    return reduceArg(v.data(), v.len(), true);
+}
+template <typename T>
+int argmax (const vector<T> & v) {
+    return reduceArg(v.data(), v.len(), false);
+}
+
+// smallest and largest elements; NaN when empty, or T() for types
+// without one
+template <typename T>
+T minimum (const vector<T> & v) {
+    int i = argmin(v);
+    return i < 0 ? std::numeric_limits<T>::quiet_NaN() : v.data()[i];
+}
+template <typename T>
+T maximum (const vector<T> & v) {
+    int i = argmax(v);
+    return i < 0 ? std::numeric_limits<T>::quiet_NaN() : v.data()[i];
+}
+
+#endif /* reduce_h */
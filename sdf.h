@@ -0,0 +1,548 @@
+//
+//  sdf.h
+//  VecLib
+//
+// Signed distance field scenes that can be edited at runtime.
+// A scene is a tree of primitives, booleans and transforms that
+// gets compiled into a flat instruction tape: transforms are baked
+// into the primitives, constant subtrees are folded away, and the
+// tape is evaluated over batches of points so every instruction
+// runs as a tight loop instead of a chain of function calls.
+//
+
+#ifndef sdf_h
+#define sdf_h
+
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <iostream>
+#include "math.h"
+
+// number of points evaluated together by one pass over the tape
+#define SDF_BATCH 64
+
+// scene node and tape instruction types
+enum sdfCode {
+    SDF_CONST,
+    SDF_SPHERE,
+    SDF_BOX,
+    SDF_TORUS,
+    SDF_PLANE,
+    SDF_UNION,
+    SDF_INTERSECT,
+    SDF_SUBTRACT,
+    SDF_SMOOTH,
+    SDF_TRANSLATE,
+    SDF_ROTATE,
+    SDF_SCALE
+};
+
+// scene node
+struct sdfNode {
+    int code;
+    int a, b;       // children
+    vec3 v;         // primitive size, plane normal or translation
+    double k;       // radius, offset, smoothing or scale factor
+    mat3 m;         // rotation
+};
+
+// primitive with its transform baked in, local = m * world + o
+struct sdfLeaf {
+    int code;
+    double m[9], o[3];
+    double s;       // distance scale back to world space
+    vec3 v;
+    double k;
+    vec3 c;         // world space bounding sphere
+    double r;
+};
+
+// tape instruction, a and b name the ops producing the operands,
+// ra, rb and out are the registers they are read from and written to
+struct sdfOp {
+    int code;
+    int a, b;
+    int ra, rb, out;
+    double k;       // constant or smoothing radius
+    int leaf;
+};
+
+// flat compiled form of a scene
+class tape {
+public:
+    std::vector<sdfOp> ops;
+    std::vector<sdfLeaf> leaves;
+    int slots = 0;
+    int result = 0;
+
+    // distances at n points; the registers are kept per thread and grow
+    // to the largest tape, so evaluating allocates nothing after warm up
+    void eval(const vec3 * p, double * d, int n) const {
+        thread_local std::vector<double> regs;
+        if(regs.size() < static_cast<size_t>(slots) * SDF_BATCH)
+            regs.resize(static_cast<size_t>(slots) * SDF_BATCH);
+        double px[SDF_BATCH], py[SDF_BATCH], pz[SDF_BATCH];
+        for(int i = 0; i < n; i += SDF_BATCH){
+            int c = std::min(SDF_BATCH, n - i);
+            for(int j = 0; j < c; j++){
+                px[j] = p[i + j].x;
+                py[j] = p[i + j].y;
+                pz[j] = p[i + j].z;
+            }
+            run(px, py, pz, c, regs.data());
+            const double * r = regs.data() + ops[result].out * SDF_BATCH;
+            for(int j = 0; j < c; j++)
+                d[i + j] = r[j];
+        }
+    }
+    double eval(vec3 p) const {
+        double d;
+        eval(&p, &d, 1);
+        return d;
+    }
+
+    // copy of this tape with every instruction that cannot affect
+    // a point inside the box [lo, hi] removed
+    tape prune(vec3 lo, vec3 hi) const {
+        int n = static_cast<int>(ops.size());
+        std::vector<double> bl(n), bh(n);
+        std::vector<int> keep(n), alias(n);
+
+        // distance bounds of every instruction over the box, from the
+        // bounding spheres of the primitives
+        for(int i = 0; i < n; i++){
+            const sdfOp & op = ops[i];
+            alias[i] = i;
+            switch(op.code){
+                case SDF_CONST:
+                    bl[i] = bh[i] = op.k;
+                break;
+                case SDF_UNION:
+                    bl[i] = std::min(bl[op.a], bl[op.b]);
+                    bh[i] = std::min(bh[op.a], bh[op.b]);
+                break;
+                case SDF_INTERSECT:
+                    bl[i] = std::max(bl[op.a], bl[op.b]);
+                    bh[i] = std::max(bh[op.a], bh[op.b]);
+                break;
+                case SDF_SUBTRACT:
+                    bl[i] = std::max(bl[op.a], -bh[op.b]);
+                    bh[i] = std::max(bh[op.a], -bl[op.b]);
+                break;
+                case SDF_SMOOTH:
+                    bl[i] = std::min(bl[op.a], bl[op.b]) - op.k * 0.25;
+                    bh[i] = std::min(bh[op.a], bh[op.b]);
+                break;
+                default:{
+                    const sdfLeaf & l = leaves[op.leaf];
+                    vec3 c = l.c;
+                    vec3 close = max(lo, min(hi, c)) - c;
+                    vec3 far = max(abs(lo - c), abs(hi - c));
+                    bl[i] = close.mag() - l.r;
+                    bh[i] = far.mag() + l.r;
+                }
+            }
+        }
+
+        // booleans whose outcome is already decided forward one operand
+        for(int i = 0; i < n; i++){
+            const sdfOp & op = ops[i];
+            if(op.code == SDF_UNION || op.code == SDF_SMOOTH){
+                double g = op.code == SDF_SMOOTH ? op.k : 0.0;
+                if(bl[op.a] >= bh[op.b] + g)
+                    alias[i] = alias[op.b];
+                else if(bl[op.b] >= bh[op.a] + g)
+                    alias[i] = alias[op.a];
+            }
+            else if(op.code == SDF_INTERSECT){
+                if(bh[op.a] <= bl[op.b])
+                    alias[i] = alias[op.b];
+                else if(bh[op.b] <= bl[op.a])
+                    alias[i] = alias[op.a];
+            }
+            else if(op.code == SDF_SUBTRACT && -bl[op.b] <= bl[op.a]){
+                alias[i] = alias[op.a];
+            }
+        }
+
+        // keep only what the result still reads
+        keep[alias[result]] = 1;
+        for(int i = n - 1; i >= 0; i--){
+            if(!keep[i] || alias[i] != i)
+                continue;
+            const sdfOp & op = ops[i];
+            if(op.code >= SDF_UNION){
+                keep[alias[op.a]] = 1;
+                keep[alias[op.b]] = 1;
+            }
+        }
+        tape t;
+        std::vector<int> id(n, -1);
+        for(int i = 0; i < n; i++){
+            if(!keep[i])
+                continue;
+            sdfOp op = ops[i];
+            if(op.code >= SDF_UNION){
+                op.a = id[alias[op.a]];
+                op.b = id[alias[op.b]];
+            }
+            else if(op.code != SDF_CONST){
+                t.leaves.push_back(leaves[op.leaf]);
+                op.leaf = static_cast<int>(t.leaves.size()) - 1;
+            }
+            id[i] = static_cast<int>(t.ops.size());
+            t.ops.push_back(op);
+        }
+        t.result = id[alias[result]];
+        t.allocate();
+        return t;
+    }
+
+    // assigns registers, reusing each one after its last read
+    void allocate(){
+        int n = static_cast<int>(ops.size());
+        std::vector<int> last(n, -1), reg(n), free;
+        for(int i = 0; i < n; i++){
+            if(ops[i].code >= SDF_UNION){
+                last[ops[i].a] = i;
+                last[ops[i].b] = i;
+            }
+        }
+        last[result] = n;
+        slots = 0;
+        for(int i = 0; i < n; i++){
+            sdfOp & op = ops[i];
+            op.ra = op.rb = 0;
+            if(op.code >= SDF_UNION){
+                op.ra = reg[op.a];
+                op.rb = reg[op.b];
+                if(last[op.a] == i)
+                    free.push_back(reg[op.a]);
+                if(last[op.b] == i && op.b != op.a)
+                    free.push_back(reg[op.b]);
+            }
+            if(free.empty()){
+                reg[i] = slots++;
+            }
+            else{
+                reg[i] = free.back();
+                free.pop_back();
+            }
+            op.out = reg[i];
+        }
+    }
+
+private:
+    // runs every instruction over one batch
+    void run(const double * px, const double * py, const double * pz, int c, double * regs) const {
+        for(const sdfOp & op : ops){
+            double * o = regs + op.out * SDF_BATCH;
+            const double * a = regs + op.ra * SDF_BATCH;
+            const double * b = regs + op.rb * SDF_BATCH;
+            switch(op.code){
+                case SDF_CONST:
+                    for(int j = 0; j < c; j++)
+                        o[j] = op.k;
+                break;
+                case SDF_UNION:
+                    for(int j = 0; j < c; j++)
+                        o[j] = a[j] < b[j] ? a[j] : b[j];
+                break;
+                case SDF_INTERSECT:
+                    for(int j = 0; j < c; j++)
+                        o[j] = a[j] > b[j] ? a[j] : b[j];
+                break;
+                case SDF_SUBTRACT:
+                    for(int j = 0; j < c; j++)
+                        o[j] = a[j] > -b[j] ? a[j] : -b[j];
+                break;
+                case SDF_SMOOTH:{
+                    double k = op.k, ik = 1.0 / op.k;
+                    for(int j = 0; j < c; j++){
+                        double h = std::max(k - std::abs(a[j] - b[j]), 0.0) * ik;
+                        o[j] = std::min(a[j], b[j]) - h * h * k * 0.25;
+                    }
+                }
+                break;
+                default:
+                    leaf(leaves[op.leaf], px, py, pz, c, o);
+            }
+        }
+    }
+
+    // primitive distances, after moving the points into local space
+    static void leaf(const sdfLeaf & l, const double * px, const double * py, const double * pz, int c, double * o){
+        const double * m = l.m;
+        double s = l.s;
+        switch(l.code){
+            case SDF_SPHERE:
+                for(int j = 0; j < c; j++){
+                    double x = m[0] * px[j] + m[1] * py[j] + m[2] * pz[j] + l.o[0];
+                    double y = m[3] * px[j] + m[4] * py[j] + m[5] * pz[j] + l.o[1];
+                    double z = m[6] * px[j] + m[7] * py[j] + m[8] * pz[j] + l.o[2];
+                    o[j] = (std::sqrt(x * x + y * y + z * z) - l.k) * s;
+                }
+            break;
+            case SDF_BOX:
+                for(int j = 0; j < c; j++){
+                    double x = std::abs(m[0] * px[j] + m[1] * py[j] + m[2] * pz[j] + l.o[0]) - l.v.x;
+                    double y = std::abs(m[3] * px[j] + m[4] * py[j] + m[5] * pz[j] + l.o[1]) - l.v.y;
+                    double z = std::abs(m[6] * px[j] + m[7] * py[j] + m[8] * pz[j] + l.o[2]) - l.v.z;
+                    double ux = std::max(x, 0.0), uy = std::max(y, 0.0), uz = std::max(z, 0.0);
+                    double in = std::min(std::max(x, std::max(y, z)), 0.0);
+                    o[j] = (std::sqrt(ux * ux + uy * uy + uz * uz) + in) * s;
+                }
+            break;
+            case SDF_TORUS:
+                for(int j = 0; j < c; j++){
+                    double x = m[0] * px[j] + m[1] * py[j] + m[2] * pz[j] + l.o[0];
+                    double y = m[3] * px[j] + m[4] * py[j] + m[5] * pz[j] + l.o[1];
+                    double z = m[6] * px[j] + m[7] * py[j] + m[8] * pz[j] + l.o[2];
+                    double q = std::sqrt(x * x + z * z) - l.v.x;
+                    o[j] = (std::sqrt(q * q + y * y) - l.k) * s;
+                }
+            break;
+            case SDF_PLANE:
+                for(int j = 0; j < c; j++){
+                    double x = m[0] * px[j] + m[1] * py[j] + m[2] * pz[j] + l.o[0];
+                    double y = m[3] * px[j] + m[4] * py[j] + m[5] * pz[j] + l.o[1];
+                    double z = m[6] * px[j] + m[7] * py[j] + m[8] * pz[j] + l.o[2];
+                    o[j] = (x * l.v.x + y * l.v.y + z * l.v.z + l.k) * s;
+                }
+            break;
+        }
+    }
+};
+
+// editable scene description
+class scene {
+public:
+    std::vector<sdfNode> nodes;
+    int root = -1;
+
+    // primitives, centered on the origin
+    int constant(double d){
+        return add(SDF_CONST, -1, -1, vec3(), d);
+    }
+    int sphere(double r){
+        return add(SDF_SPHERE, -1, -1, vec3(), r);
+    }
+    int box(vec3 half){
+        return add(SDF_BOX, -1, -1, half, 0.0);
+    }
+    int torus(double R, double r){
+        return add(SDF_TORUS, -1, -1, vec3(R, 0.0, 0.0), r);
+    }
+    int plane(vec3 n, double h){
+        n.norm();
+        return add(SDF_PLANE, -1, -1, n, h);
+    }
+
+    // booleans
+    int unite(int a, int b){
+        return add(SDF_UNION, a, b, vec3(), 0.0);
+    }
+    int intersect(int a, int b){
+        return add(SDF_INTERSECT, a, b, vec3(), 0.0);
+    }
+    int subtract(int a, int b){
+        return add(SDF_SUBTRACT, a, b, vec3(), 0.0);
+    }
+    int smooth(int a, int b, double k){
+        return add(SDF_SMOOTH, a, b, vec3(), k);
+    }
+
+    // transforms, rotations must be orthonormal and scale factors
+    // positive and finite; any other factor leaves a unscaled
+    int translate(int a, vec3 t){
+        return add(SDF_TRANSLATE, a, -1, t, 0.0);
+    }
+    int rotate(int a, mat3 m){
+        int n = add(SDF_ROTATE, a, -1, vec3(), 0.0);
+        nodes[n].m = m;
+        return n;
+    }
+    int scale(int a, double s){
+        if(!(s > 0.0 && std::isfinite(s)))
+            return a;
+        return add(SDF_SCALE, a, -1, vec3(), s);
+    }
+
+    // flattens the scene below root into a tape
+    tape compile(){
+        tape t;
+        double m[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1}, o[3] = {0, 0, 0};
+        double k = 0.0;
+        if(root < 0 || emit(t, root, m, o, 1.0, k))
+            push(t, SDF_CONST, -1, -1, root < 0 ? std::numeric_limits<double>::infinity() : k, -1);
+        t.result = static_cast<int>(t.ops.size()) - 1;
+        t.allocate();
+        return t;
+    }
+
+private:
+    int add(int code, int a, int b, vec3 v, double k){
+        sdfNode n;
+        n.code = code;
+        n.a = a;
+        n.b = b;
+        n.v = v;
+        n.k = k;
+        nodes.push_back(n);
+        return static_cast<int>(nodes.size()) - 1;
+    }
+
+    static int push(tape & t, int code, int a, int b, double k, int leaf){
+        sdfOp op;
+        op.code = code;
+        op.a = a;
+        op.b = b;
+        op.out = static_cast<int>(t.ops.size());
+        op.k = k;
+        op.leaf = leaf;
+        t.ops.push_back(op);
+        return op.out;
+    }
+
+    // emits node i under the world to local transform (m, o) with
+    // distance scale s; returns true with the value in c when the
+    // whole subtree folds to a constant, otherwise the subtree's
+    // result is the last op on the tape
+    bool emit(tape & t, int i, const double * m, const double * o, double s, double & c){
+        sdfNode n = nodes[i];
+        switch(n.code){
+            case SDF_CONST:
+                c = n.k * s;
+                return true;
+            case SDF_TRANSLATE:{
+                double p[3] = {o[0] - n.v.x, o[1] - n.v.y, o[2] - n.v.z};
+                return emit(t, n.a, m, p, s, c);
+            }
+            case SDF_ROTATE:{
+                // the child sees the points rotated back by the transpose
+                double r[9] = {n.m.x.x, n.m.y.x, n.m.z.x, n.m.x.y, n.m.y.y, n.m.z.y, n.m.x.z, n.m.y.z, n.m.z.z};
+                double q[9], p[3];
+                for(int a = 0; a < 3; a++){
+                    for(int b = 0; b < 3; b++)
+                        q[a * 3 + b] = r[a * 3] * m[b] + r[a * 3 + 1] * m[3 + b] + r[a * 3 + 2] * m[6 + b];
+                    p[a] = r[a * 3] * o[0] + r[a * 3 + 1] * o[1] + r[a * 3 + 2] * o[2];
+                }
+                return emit(t, n.a, q, p, s, c);
+            }
+            case SDF_SCALE:{
+                double f = 1.0 / n.k, q[9], p[3] = {o[0] * f, o[1] * f, o[2] * f};
+                for(int a = 0; a < 9; a++)
+                    q[a] = m[a] * f;
+                return emit(t, n.a, q, p, s * n.k, c);
+            }
+            case SDF_UNION:
+            case SDF_INTERSECT:
+            case SDF_SUBTRACT:
+            case SDF_SMOOTH:{
+                size_t mark = t.ops.size(), leaves = t.leaves.size();
+                double ca = 0.0, cb = 0.0;
+                bool fa = emit(t, n.a, m, o, s, ca);
+                int a = fa ? -1 : static_cast<int>(t.ops.size()) - 1;
+                bool fb = emit(t, n.b, m, o, s, cb);
+                int b = fb ? -1 : static_cast<int>(t.ops.size()) - 1;
+                double k = n.k * s;
+                if(fa && fb){
+                    c = combine(n.code, ca, cb, k);
+                    return true;
+                }
+
+                // an infinite constant either decides the result on its
+                // own, and the other side is dropped, or does nothing and
+                // the other side, already last on the tape, is the result
+                double inf = std::numeric_limits<double>::infinity();
+                double e = fa ? ca : cb;
+                bool absorbs = n.code == SDF_INTERSECT ? e == inf : n.code == SDF_SUBTRACT ? (fa && e == inf) || (fb && e == -inf) : e == -inf;
+                bool neutral = n.code == SDF_INTERSECT ? e == -inf : n.code == SDF_SUBTRACT ? fb && e == inf : e == inf;
+                if(absorbs){
+                    t.ops.resize(mark);
+                    t.leaves.resize(leaves);
+                    c = n.code == SDF_UNION || n.code == SDF_SMOOTH ? -inf : inf;
+                    return true;
+                }
+                if(neutral)
+                    return false;
+                if(fa)
+                    a = push(t, SDF_CONST, -1, -1, ca, -1);
+                if(fb)
+                    b = push(t, SDF_CONST, -1, -1, cb, -1);
+                push(t, n.code == SDF_SMOOTH && k <= 0.0 ? SDF_UNION : n.code, a, b, k, -1);
+                return false;
+            }
+            default:{
+                sdfLeaf l;
+                l.code = n.code;
+                for(int a = 0; a < 9; a++)
+                    l.m[a] = m[a];
+                for(int a = 0; a < 3; a++)
+                    l.o[a] = o[a];
+                l.s = s;
+                l.v = n.v;
+                l.k = n.k;
+
+                // local bounding sphere sits on the origin; world center
+                // is m^-1 * -o where m^-1 = s * s * m^T
+                double r = n.code == SDF_SPHERE ? n.k : n.code == SDF_BOX ? n.v.mag() : n.code == SDF_TORUS ? n.v.x + n.k : std::numeric_limits<double>::infinity();
+                double ss = s * s;
+                l.c = vec3(-ss * (m[0] * o[0] + m[3] * o[1] + m[6] * o[2]),
+                           -ss * (m[1] * o[0] + m[4] * o[1] + m[7] * o[2]),
+                           -ss * (m[2] * o[0] + m[5] * o[1] + m[8] * o[2]));
+                l.r = r * s;
+                t.leaves.push_back(l);
+                push(t, n.code, -1, -1, 0.0, static_cast<int>(t.leaves.size()) - 1);
+                return false;
+            }
+        }
+    }
+
+    static double combine(int code, double a, double b, double k){
+        switch(code){
+            case SDF_UNION:
+                return std::min(a, b);
+            case SDF_INTERSECT:
+                return std::max(a, b);
+            case SDF_SUBTRACT:
+                return std::max(a, -b);
+            default:{
+                if(k <= 0.0)
+                    return std::min(a, b);
+                double h = std::max(k - std::abs(a - b), 0.0) / k;
+                return std::min(a, b) - h * h * k * 0.25;
+            }
+        }
+    }
+};
+
+// marches n rays through a compiled scene together, one batched tape
+// evaluation per step for every ray that has not yet converged
+void march(ray * rays, int n, const tape & t, double err, int max){
+    PROFILE_SCOPE("march", 0, 0);
+    std::vector<vec3> p(n);
+    std::vector<double> d(n);
+    std::vector<int> live(n);
+    for(int i = 0; i < n; i++)
+        live[i] = i;
+    for(; max >= 0 && !live.empty(); max--){
+        int m = static_cast<int>(live.size());
+        for(int i = 0; i < m; i++){
+            ray & r = rays[live[i]];
+            p[i] = r.o + r.d * r.t;
+        }
+        t.eval(p.data(), d.data(), m);
+        PROFILE_WORK(0, 0, m);
+        int k = 0;
+        for(int i = 0; i < m; i++){
+            rays[live[i]].t += d[i];
+            if(d[i] > err)
+                live[k++] = live[i];
+        }
+        live.resize(k);
+    }
+}
+
+#endif /* sdf_h */
@@ -0,0 +1,474 @@
+//
+//  sparse.h
+//  VecLib
+//
+// Sparse matrices in compressed row (CSR) and compressed column (CSC)
+// form, built from coordinate lists. Both keep the same storage, a list
+// of lines with the sorted indices and values of each line's nonzeros:
+// lines are rows for CSR and columns for CSC, so the CSC form of a
+// matrix is the CSR form of its transpose and converting between them
+// is one counting sort.
+//
+// Products against vector<T> and dense matrix<T> run over the shared
+// thread pool. Along lines, as for CSR times a vector, each thread
+// gathers into its own stretch of the output, and the lines are cut
+// into stretches with equal nonzeros rather than equal line counts, so
+// a few dense rows do not leave one thread with most of the work.
+// Across lines, as for CSC times a vector, each thread scatters into a
+// partial output of its own and the partials are added up at the end.
+//
+
+#ifndef sparse_h
+#define sparse_h
+
+#include <vector>
+#include <algorithm>
+#include "math.h"
+#include "parallel.h"
+
+// nonzeros per thread before a product is split
+#define SPARSE_PARALLEL (1 << 15)
+
+// unsorted (row, column, value) entries; repeats are summed when it is
+// compressed
+template <typename T>
+class cooMatrix {
+public:
+    cooMatrix(int r = 0, int c = 0) : rows(r), cols(c) {}
+
+    void add(int r, int c, T v) {
+        row.push_back(r);
+        col.push_back(c);
+        value.push_back(v);
+    }
+
+    int height() const {
+        return rows;
+    }
+    int width() const {
+        return cols;
+    }
+    int count() const {
+        return static_cast<int>(value.size());
+    }
+
+    std::vector<int> row, col;
+    std::vector<T> value;
+
+private:
+    int rows, cols;
+};
+
+// lines of sorted nonzeros, line o holding entries [start[o], start[o + 1])
+template <typename T>
+struct sparseLines {
+    int outer = 0, inner = 0;
+    std::vector<int> start = std::vector<int>(1, 0), index;
+    std::vector<T> value;
+
+    int count() const {
+        return start[outer];
+    }
+};
+
+// o, i and v of n entries into lines of s, sorted within each line and
+// with repeats summed; a stable counting sort by i and then by o
+template <typename T>
+void sparseCompress(int outer, int inner, const int * o, const int * i, const T * v, int n, sparseLines<T> & s){
+    PROFILE_SCOPE("sparseCompress", 0, 0);
+    std::vector<int> count(std::max(outer, inner) + 1), byInner(n), order(n);
+    for(int k = 0; k < n; k++)
+        count[i[k] + 1]++;
+    for(int c = 0; c < inner; c++)
+        count[c + 1] += count[c];
+    for(int k = 0; k < n; k++)
+        byInner[count[i[k]]++] = k;
+    std::fill(count.begin(), count.end(), 0);
+    for(int k = 0; k < n; k++)
+        count[o[k] + 1]++;
+    for(int r = 0; r < outer; r++)
+        count[r + 1] += count[r];
+    for(int k : byInner)
+        order[count[o[k]]++] = k;
+
+    s.outer = outer;
+    s.inner = inner;
+    s.start.assign(outer + 1, 0);
+    s.index.clear();
+    s.value.clear();
+    s.index.reserve(n);
+    s.value.reserve(n);
+    for(int a = 0, r = 0; r < outer; r++){
+        for(; a < n && o[order[a]] == r; a++){
+            int k = order[a];
+            if(static_cast<int>(s.index.size()) > s.start[r] && s.index.back() == i[k])
+                s.value.back() += v[k];
+            else{
+                s.index.push_back(i[k]);
+                s.value.push_back(v[k]);
+            }
+        }
+        s.start[r + 1] = static_cast<int>(s.index.size());
+    }
+}
+
+// lines of s turned the other way, the transpose of the matrix they hold
+template <typename T>
+sparseLines<T> sparseTranspose(const sparseLines<T> & s){
+    PROFILE_SCOPE("sparseTranspose", 0, static_cast<uint64_t>(s.count()) * (sizeof(int) + sizeof(T)));
+    sparseLines<T> t;
+    t.outer = s.inner;
+    t.inner = s.outer;
+    t.start.assign(t.outer + 1, 0);
+    t.index.resize(s.count());
+    t.value.resize(s.count());
+    for(int k = 0; k < s.count(); k++)
+        t.start[s.index[k] + 1]++;
+    for(int c = 0; c < t.outer; c++)
+        t.start[c + 1] += t.start[c];
+    // lines of s in order keep every line of t sorted
+    std::vector<int> at(t.start.begin(), t.start.end() - 1);
+    for(int o = 0; o < s.outer; o++)
+        for(int k = s.start[o]; k < s.start[o + 1]; k++){
+            int p = at[s.index[k]]++;
+            t.index[p] = o;
+            t.value[p] = s.value[k];
+        }
+    return t;
+}
+
+// cuts the lines of s into t stretches of about equal weight, weighing
+// each line by its nonzeros plus one for the line itself; stretch c is
+// lines [cut[c], cut[c + 1])
+template <typename T>
+std::vector<int> sparsePartition(const sparseLines<T> & s, int t){
+    std::vector<int> cut(t + 1, s.outer);
+    cut[0] = 0;
+    long total = static_cast<long>(s.count()) + s.outer;
+    for(int c = 1; c < t; c++){
+        long goal = total * c / t;
+        // first line whose weight before it reaches the goal
+        int lo = cut[c - 1], hi = s.outer;
+        while(lo < hi){
+            int mid = lo + (hi - lo) / 2;
+            if(static_cast<long>(s.start[mid]) + mid < goal)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        cut[c] = lo;
+    }
+    return cut;
+}
+
+// threads worth using on the lines of s
+template <typename T>
+int sparseThreads(const sparseLines<T> & s, int width = 1){
+    return std::max(1, std::min(threadCount(), static_cast<int>(static_cast<long>(s.count()) * width / SPARSE_PARALLEL)));
+}
+
+// runs f(c, begin, end) on t stretches of lines with equal nonzeros,
+// stretch c on its own thread
+template <typename T, typename F>
+void sparseRun(const sparseLines<T> & s, int t, F f){
+    if(t <= 1){
+        f(0, 0, s.outer);
+        return;
+    }
+    std::vector<int> cut = sparsePartition(s, t);
+    sharedPool().run(t, [&](int c){
+        f(c, cut[c], cut[c + 1]);
+    });
+}
+
+// y[o] = the sum over line o of its values times x at their indices, for
+// each line o; rows of k values, with y outer rows and x inner
+template <typename T>
+void sparseGather(const sparseLines<T> & s, const T * x, T * y, int k = 1){
+    sparseRun(s, sparseThreads(s, k), [&](int, int b, int e){
+        for(int o = b; o < e; o++){
+            T * yo = y + static_cast<size_t>(o) * k;
+            std::fill(yo, yo + k, T(0));
+            for(int p = s.start[o]; p < s.start[o + 1]; p++){
+                T v = s.value[p];
+                const T * xi = x + static_cast<size_t>(s.index[p]) * k;
+                for(int j = 0; j < k; j++)
+                    yo[j] += v * xi[j];
+            }
+        }
+    });
+}
+
+// y[i] = the sum of every value with index i times x at its line. The
+// first thread scatters straight into y and the others into partials of
+// their own, added to y in thread order afterwards
+template <typename T>
+void sparseScatter(const sparseLines<T> & s, const T * x, T * y){
+    int t = sparseThreads(s);
+    std::vector<T> part(static_cast<size_t>(t - 1) * s.inner);
+    std::fill(y, y + s.inner, T(0));
+    sparseRun(s, t, [&](int c, int b, int e){
+        T * out = c ? part.data() + static_cast<size_t>(c - 1) * s.inner : y;
+        for(int o = b; o < e; o++){
+            T xo = x[o];
+            for(int p = s.start[o]; p < s.start[o + 1]; p++)
+                out[s.index[p]] += s.value[p] * xo;
+        }
+    });
+    if(t > 1)
+        parallelFor(s.inner, SPARSE_PARALLEL / t, [&](int b, int e){
+            for(int c = 0; c < t - 1; c++){
+                const T * q = part.data() + static_cast<size_t>(c) * s.inner;
+                for(int i = b; i < e; i++)
+                    y[i] += q[i];
+            }
+        });
+}
+
+// lines [b, e) of s
+template <typename T>
+sparseLines<T> sparseOuterSlice(const sparseLines<T> & s, int b, int e){
+    sparseLines<T> t;
+    t.outer = e - b;
+    t.inner = s.inner;
+    t.start.resize(e - b + 1);
+    for(int o = b; o <= e; o++)
+        t.start[o - b] = s.start[o] - s.start[b];
+    t.index.assign(s.index.begin() + s.start[b], s.index.begin() + s.start[e]);
+    t.value.assign(s.value.begin() + s.start[b], s.value.begin() + s.start[e]);
+    return t;
+}
+
+// entries of s with index in [b, e), renumbered from 0; each line's
+// range is found by binary search, counted, then copied
+template <typename T>
+sparseLines<T> sparseInnerSlice(const sparseLines<T> & s, int b, int e){
+    sparseLines<T> t;
+    t.outer = s.outer;
+    t.inner = e - b;
+    t.start.assign(s.outer + 1, 0);
+    std::vector<int> first(s.outer);
+    for(int o = 0; o < s.outer; o++){
+        const int * l = s.index.data() + s.start[o], * r = s.index.data() + s.start[o + 1];
+        const int * f = std::lower_bound(l, r, b);
+        first[o] = static_cast<int>(f - s.index.data());
+        t.start[o + 1] = t.start[o] + static_cast<int>(std::lower_bound(f, r, e) - f);
+    }
+    t.index.resize(t.count());
+    t.value.resize(t.count());
+    for(int o = 0; o < s.outer; o++)
+        for(int p = t.start[o]; p < t.start[o + 1]; p++){
+            t.index[p] = s.index[first[o] + p - t.start[o]] - b;
+            t.value[p] = s.value[first[o] + p - t.start[o]];
+        }
+    return t;
+}
+
+// entry i of line o, 0 if it is not stored
+template <typename T>
+T sparseAt(const sparseLines<T> & s, int o, int i){
+    const int * l = s.index.data() + s.start[o], * r = s.index.data() + s.start[o + 1];
+    const int * f = std::lower_bound(l, r, i);
+    return f != r && *f == i ? s.value[f - s.index.data()] : T(0);
+}
+
+template <typename T>
+class cscMatrix;
+
+// compressed rows
+template <typename T>
+class csrMatrix {
+public:
+    // empty r x c
+    csrMatrix(int r = 0, int c = 0) {
+        lines.outer = r;
+        lines.inner = c;
+        lines.start.assign(r + 1, 0);
+    }
+    csrMatrix(const cooMatrix<T> & a) {
+        sparseCompress(a.height(), a.width(), a.row.data(), a.col.data(), a.value.data(), a.count(), lines);
+    }
+    // the nonzeros of a dense matrix
+    csrMatrix(const matrix<T> & a) {
+        cooMatrix<T> c(a.height(), a.width());
+        for(int i = 0; i < a.height(); i++)
+            for(int j = 0; j < a.width(); j++)
+                if(a(i, j) != T(0))
+                    c.add(i, j, a(i, j));
+        sparseCompress(c.height(), c.width(), c.row.data(), c.col.data(), c.value.data(), c.count(), lines);
+    }
+
+    int height() const {
+        return lines.outer;
+    }
+    int width() const {
+        return lines.inner;
+    }
+    int nonzeros() const {
+        return lines.count();
+    }
+
+    // row r is entries [starts()[r], starts()[r + 1]) of columns() and
+    // values(), columns increasing
+    const int * starts() const {
+        return lines.start.data();
+    }
+    const int * columns() const {
+        return lines.index.data();
+    }
+    const T * values() const {
+        return lines.value.data();
+    }
+
+    T at(int r, int c) const {
+        return sparseAt(lines, r, c);
+    }
+
+    // a x, and a^T x
+    vector<T> operator * (const vector<T> & x) const {
+        PROFILE_SCOPE("csrMatrix::operator*", 2 * static_cast<uint64_t>(nonzeros()), 0);
+        vector<T> y(height());
+        sparseGather(lines, x.data(), y.data());
+        return y;
+    }
+    vector<T> transposeProduct(const vector<T> & x) const {
+        PROFILE_SCOPE("csrMatrix::transposeProduct", 2 * static_cast<uint64_t>(nonzeros()), 0);
+        vector<T> y(width());
+        sparseScatter(lines, x.data(), y.data());
+        return y;
+    }
+
+    // a b for dense b, each row of the result a sum of rows of b
+    matrix<T> operator * (const matrix<T> & b) const {
+        PROFILE_SCOPE("csrMatrix::operator*", 2 * static_cast<uint64_t>(nonzeros()) * b.width(), 0);
+        matrix<T> c(height(), b.width());
+        sparseGather(lines, b.data(), c.data(), b.width());
+        return c;
+    }
+
+    csrMatrix<T> transpose() const {
+        return csrMatrix<T>(sparseTranspose(lines));
+    }
+    cscMatrix<T> csc() const;
+
+    // rows [r0, r1), and columns [c0, c1)
+    csrMatrix<T> rows(int r0, int r1) const {
+        return csrMatrix<T>(sparseOuterSlice(lines, r0, r1));
+    }
+    csrMatrix<T> columns(int c0, int c1) const {
+        return csrMatrix<T>(sparseInnerSlice(lines, c0, c1));
+    }
+
+    matrix<T> dense() const {
+        matrix<T> d(height(), width());
+        for(int r = 0; r < height(); r++)
+            for(int p = lines.start[r]; p < lines.start[r + 1]; p++)
+                d(r, lines.index[p]) = lines.value[p];
+        return d;
+    }
+
+private:
+    sparseLines<T> lines;
+
+    csrMatrix(sparseLines<T> && s) : lines(std::move(s)) {}
+
+    friend class cscMatrix<T>;
+};
+
+// compressed columns
+template <typename T>
+class cscMatrix {
+public:
+    cscMatrix(int r = 0, int c = 0) {
+        lines.outer = c;
+        lines.inner = r;
+        lines.start.assign(c + 1, 0);
+    }
+    cscMatrix(const cooMatrix<T> & a) {
+        sparseCompress(a.width(), a.height(), a.col.data(), a.row.data(), a.value.data(), a.count(), lines);
+    }
+    cscMatrix(const matrix<T> & a) : lines(sparseTranspose(csrMatrix<T>(a).lines)) {}
+
+    int height() const {
+        return lines.inner;
+    }
+    int width() const {
+        return lines.outer;
+    }
+    int nonzeros() const {
+        return lines.count();
+    }
+
+    // column c is entries [starts()[c], starts()[c + 1]) of rows() and
+    // values(), rows increasing
+    const int * starts() const {
+        return lines.start.data();
+    }
+    const int * rows() const {
+        return lines.index.data();
+    }
+    const T * values() const {
+        return lines.value.data();
+    }
+
+    T at(int r, int c) const {
+        return sparseAt(lines, c, r);
+    }
+
+    // a x, and a^T x
+    vector<T> operator * (const vector<T> & x) const {
+        PROFILE_SCOPE("cscMatrix::operator*", 2 * static_cast<uint64_t>(nonzeros()), 0);
+        vector<T> y(height());
+        sparseScatter(lines, x.data(), y.data());
+        return y;
+    }
+    vector<T> transposeProduct(const vector<T> & x) const {
+        PROFILE_SCOPE("cscMatrix::transposeProduct", 2 * static_cast<uint64_t>(nonzeros()), 0);
+        vector<T> y(width());
+        sparseGather(lines, x.data(), y.data());
+        return y;
+    }
+
+    // a b for dense b, through the row form: scattering whole rows of
+    // the result would need a partial matrix per thread
+    matrix<T> operator * (const matrix<T> & b) const {
+        return csr() * b;
+    }
+
+    cscMatrix<T> transpose() const {
+        return cscMatrix<T>(sparseTranspose(lines));
+    }
+    csrMatrix<T> csr() const {
+        return csrMatrix<T>(sparseTranspose(lines));
+    }
+
+    // columns [c0, c1), and rows [r0, r1)
+    cscMatrix<T> columns(int c0, int c1) const {
+        return cscMatrix<T>(sparseOuterSlice(lines, c0, c1));
+    }
+    cscMatrix<T> rows(int r0, int r1) const {
+        return cscMatrix<T>(sparseInnerSlice(lines, r0, r1));
+    }
+
+    matrix<T> dense() const {
+        matrix<T> d(height(), width());
+        for(int c = 0; c < width(); c++)
+            for(int p = lines.start[c]; p < lines.start[c + 1]; p++)
+                d(lines.index[p], c) = lines.value[p];
+        return d;
+    }
+
+private:
+    sparseLines<T> lines;
+
+    cscMatrix(sparseLines<T> && s) : lines(std::move(s)) {}
+
+    friend class csrMatrix<T>;
+};
+
+template <typename T>
+cscMatrix<T> csrMatrix<T>::csc() const {
+    return cscMatrix<T>(sparseTranspose(lines));
+}
+
+#endif /* sparse_h */
@@ -0,0 +1,238 @@
+//
+//  tally.h
+//  VecLib
+//
+// Group by aggregation over keyed vec4 records. Records are stored by
+// column, one array per component plus the key of each row, so a
+// transform like min(floor(v / 6), 2) runs as a tight loop over each
+// column a block at a time. A tally is the list of transform steps;
+// summing a table with it splits the rows over the shared thread pool,
+// keeps one partial sum per key per thread and adds the partials up in
+// thread order at the end.
+//
+
+#ifndef tally_h
+#define tally_h
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <unordered_map>
+#include "math.h"
+#include "parallel.h"
+
+// rows transformed at a time, and rows per thread before splitting
+#define TALLY_BLOCK 1024
+#define TALLY_PARALLEL (1 << 15)
+
+// columnar table of (key, vec4) rows
+class records {
+public:
+    std::vector<int> key;
+    std::vector<double> x, y, z, w;
+
+    // keys can be given up front so several tables number them the same
+    records(std::vector<std::string> keys = std::vector<std::string>()) {
+        for(const std::string & k : keys)
+            id(k);
+    }
+
+    // number of a key, added if new
+    int id(const std::string & name) {
+        auto it = ids.find(name);
+        if(it != ids.end())
+            return it->second;
+        ids[name] = static_cast<int>(names.size());
+        names.push_back(name);
+        return static_cast<int>(names.size()) - 1;
+    }
+
+    // key of a number
+    const std::string & name(int k) const {
+        return names[k];
+    }
+
+    // distinct keys and rows
+    int keys() const {
+        return static_cast<int>(names.size());
+    }
+    int size() const {
+        return static_cast<int>(key.size());
+    }
+
+    // adds a row
+    void add(int k, vec4 v) {
+        key.push_back(k);
+        x.push_back(v.x);
+        y.push_back(v.y);
+        z.push_back(v.z);
+        w.push_back(v.w);
+    }
+    void add(const std::string & name, vec4 v) {
+        add(id(name), v);
+    }
+
+    // row i
+    vec4 get(int i) const {
+        return vec4(x[i], y[i], z[i], w[i]);
+    }
+
+    // adds the rows of another table, matching its keys up by name
+    void append(const records & r) {
+        std::vector<int> map(r.keys());
+        for(int k = 0; k < r.keys(); k++)
+            map[k] = id(r.name(k));
+        reserve(size() + r.size());
+        for(int i = 0; i < r.size(); i++)
+            key.push_back(map[r.key[i]]);
+        x.insert(x.end(), r.x.begin(), r.x.end());
+        y.insert(y.end(), r.y.begin(), r.y.end());
+        z.insert(z.end(), r.z.begin(), r.z.end());
+        w.insert(w.end(), r.w.begin(), r.w.end());
+    }
+
+    // drops the rows, keeping the keys and their numbers
+    void clear() {
+        key.clear();
+        x.clear();
+        y.clear();
+        z.clear();
+        w.clear();
+    }
+
+    // room for n rows
+    void reserve(int n) {
+        key.reserve(n);
+        x.reserve(n);
+        y.reserve(n);
+        z.reserve(n);
+        w.reserve(n);
+    }
+
+private:
+    std::vector<std::string> names;
+    std::unordered_map<std::string, int> ids;
+};
+
+// transform steps, each with one parameter per component
+enum tallyOp {TALLY_SCALE, TALLY_DIVIDE, TALLY_FLOOR, TALLY_ROUND, TALLY_MIN, TALLY_MAX};
+
+class tally {
+public:
+    // steps, applied in the order they are added
+    tally & scale(double s) {
+        return step(TALLY_SCALE, vec4(s, s, s, s));
+    }
+    tally & scale(vec4 s) {
+        return step(TALLY_SCALE, s);
+    }
+    tally & divide(double d) {
+        return step(TALLY_DIVIDE, vec4(d, d, d, d));
+    }
+    tally & divide(vec4 d) {
+        return step(TALLY_DIVIDE, d);
+    }
+    tally & floor() {
+        return step(TALLY_FLOOR, vec4(0, 0, 0, 0));
+    }
+    tally & round() {
+        return step(TALLY_ROUND, vec4(0, 0, 0, 0));
+    }
+    tally & min(double m) {
+        return step(TALLY_MIN, vec4(m, m, m, m));
+    }
+    tally & max(double m) {
+        return step(TALLY_MAX, vec4(m, m, m, m));
+    }
+
+    // transformed rows summed per key, added onto sums (resized to the
+    // table's keys if it is smaller)
+    void sum(const records & r, std::vector<vec4> & sums) const {
+        int n = r.size(), k = r.keys();
+        if(static_cast<int>(sums.size()) < k)
+            sums.resize(k, vec4(0, 0, 0, 0));
+        int t = std::max(1, std::min(threadCount(), n / TALLY_PARALLEL));
+        std::vector<double> part(static_cast<size_t>(t) * k * 4, 0.0);
+        sharedPool().run(t, [&](int c){
+            run(r, static_cast<int>(static_cast<long>(n) * c / t), static_cast<int>(static_cast<long>(n) * (c + 1) / t), part.data() + static_cast<size_t>(c) * k * 4);
+        });
+        for(int c = 0; c < t; c++){
+            const double * p = part.data() + static_cast<size_t>(c) * k * 4;
+            for(int g = 0; g < k; g++)
+                sums[g] += vec4(p[4 * g], p[4 * g + 1], p[4 * g + 2], p[4 * g + 3]);
+        }
+    }
+    std::vector<vec4> sum(const records & r) const {
+        std::vector<vec4> sums;
+        sum(r, sums);
+        return sums;
+    }
+
+private:
+    std::vector<int> ops;
+    std::vector<vec4> args;
+
+    tally & step(int op, vec4 a) {
+        ops.push_back(op);
+        args.push_back(a);
+        return *this;
+    }
+
+    // one step over a column
+    static void apply(int op, double a, double * c, int m) {
+        switch(op){
+            case TALLY_SCALE:
+                for(int i = 0; i < m; i++)
+                    c[i] *= a;
+                break;
+            case TALLY_DIVIDE:
+                for(int i = 0; i < m; i++)
+                    c[i] /= a;
+                break;
+            case TALLY_FLOOR:
+                for(int i = 0; i < m; i++)
+                    c[i] = std::floor(c[i]);
+                break;
+            case TALLY_ROUND:
+                for(int i = 0; i < m; i++)
+                    c[i] = std::round(c[i]);
+                break;
+            case TALLY_MIN:
+                for(int i = 0; i < m; i++)
+                    c[i] = c[i] < a ? c[i] : a;
+                break;
+            case TALLY_MAX:
+                for(int i = 0; i < m; i++)
+                    c[i] = c[i] > a ? c[i] : a;
+                break;
+        }
+    }
+
+    // rows [b, e) transformed a block at a time and added into part,
+    // four sums per key
+    void run(const records & r, int b, int e, double * part) const {
+        double col[4][TALLY_BLOCK];
+        const double * src[4] = {r.x.data(), r.y.data(), r.z.data(), r.w.data()};
+        for(int i = b; i < e; i += TALLY_BLOCK){
+            int m = std::min(TALLY_BLOCK, e - i);
+            for(int d = 0; d < 4; d++){
+                std::copy(src[d] + i, src[d] + i + m, col[d]);
+                for(size_t s = 0; s < ops.size(); s++){
+                    vec4 a = args[s];
+                    apply(ops[s], d == 0 ? a.x : d == 1 ? a.y : d == 2 ? a.z : a.w, col[d], m);
+                }
+            }
+            const int * key = r.key.data() + i;
+            for(int j = 0; j < m; j++){
+                double * g = part + 4 * key[j];
+                g[0] += col[0][j];
+                g[1] += col[1][j];
+                g[2] += col[2][j];
+                g[3] += col[3][j];
+            }
+        }
+    }
+};
+
+#endif /* tally_h */
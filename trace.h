@@ -0,0 +1,406 @@
+//
+//  trace.h
+//  VecLib
+//
+// Optional allocation tracing. Built with VECLIB_TRACE defined, the
+// global operator new and delete are replaced by versions that put a
+// small header in front of each block, and every allocation is charged
+// to the call stack of traced operations running on its thread at the
+// time. The stack is made of the names given to TRACE_SCOPE, which every
+// PROFILE_SCOPE probe also opens, so polyPow calling polyMult shows up
+// as "polyPow;polyMult". Each stack and each operation keeps its number
+// of allocations and frees, the bytes asked for, and the bytes still
+// live along with their peak.
+//
+// traceReport() writes a summary by operation and by call stack, and
+// traceFlame() writes the stacks in the collapsed format flame graph
+// tools read, weighted by bytes. Without VECLIB_TRACE nothing is
+// replaced, TRACE_SCOPE expands to nothing and the reports are empty.
+// Since operator new can only be replaced once, the header belongs in
+// one translation unit, like the rest of the library.
+//
+
+#ifndef trace_h
+#define trace_h
+
+#include <new>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ostream>
+#include <algorithm>
+
+// deepest stack told apart, distinct operation names and distinct
+// stacks; operations past TRACE_FRAMES are counted together as "other"
+#define TRACE_DEPTH 32
+#define TRACE_FRAMES 512
+#define TRACE_STACKS 4096
+
+// totals of one operation or call stack, names of stacks joined by ';'
+struct traceEntry {
+    std::string name;
+    uint64_t allocs, frees, bytes;
+    int64_t live, peak;
+};
+
+#ifdef VECLIB_TRACE
+
+// counts shared by operations and stacks
+struct traceCounts {
+    uint64_t allocs = 0, frees = 0, bytes = 0;
+    int64_t live = 0, peak = 0;
+
+    void take(uint64_t n){
+        allocs++;
+        bytes += n;
+        live += n;
+        peak = std::max(peak, live);
+    }
+    void give(uint64_t n){
+        frees++;
+        live -= n;
+    }
+};
+
+// one call stack, frames outermost first
+struct traceStack {
+    int depth = -1;
+    int frame[TRACE_DEPTH] = {};
+    traceCounts counts;
+};
+
+// the operation stack of this thread, and whether the tracer itself is
+// running on it, in which case allocations go uncounted
+struct traceThread {
+    int depth = 0;
+    int frame[TRACE_DEPTH] = {};
+    int stack = -1;
+    bool busy = false;
+};
+traceThread & traceLocal(){
+    thread_local traceThread t;
+    return t;
+}
+
+class traceRegistry {
+public:
+    traceRegistry(){
+        names[frames++] = "other";
+    }
+
+    // number of an operation name, one call per trace site, 0 once the
+    // table is full
+    int frame(const char * name){
+        traceThread & t = traceLocal();
+        t.busy = true;
+        std::lock_guard<std::mutex> l(lock);
+        int f = 1;
+        while(f < frames && std::strcmp(names[f], name))
+            f++;
+        if(f == frames && frames < TRACE_FRAMES)
+            names[frames++] = name;
+        t.busy = false;
+        return f < TRACE_FRAMES ? f : 0;
+    }
+
+    // an allocation of n bytes by this thread, the stack it was charged
+    // to returned for the free, -1 if only counted in the total, -2 if
+    // made by the tracer
+    int take(uint64_t n){
+        traceThread & t = traceLocal();
+        if(t.busy)
+            return -2;
+        t.busy = true;
+        std::lock_guard<std::mutex> l(lock);
+        if(t.stack < 0)
+            t.stack = find(t);
+        total.take(n);
+        if(t.stack >= 0){
+            stacks[t.stack].counts.take(n);
+            if(t.depth)
+                ops[t.frame[std::min(t.depth, TRACE_DEPTH) - 1]].take(n);
+        }
+        t.busy = false;
+        return t.stack;
+    }
+
+    // a free of n bytes allocated on stack s
+    void give(int s, uint64_t n){
+        if(s < -1)
+            return;
+        std::lock_guard<std::mutex> l(lock);
+        total.give(n);
+        if(s >= 0){
+            stacks[s].counts.give(n);
+            if(stacks[s].depth)
+                ops[stacks[s].frame[std::min(stacks[s].depth, TRACE_DEPTH) - 1]].give(n);
+        }
+    }
+
+    // entries for the operations, the stacks and the whole program, left
+    // out if nothing was allocated since the last reset. Blocks freed
+    // under the lock must have been made by the tracer, so the lists are
+    // built apart and only handed over once it is released
+    void snapshot(std::vector<traceEntry> & operations, std::vector<traceEntry> & calls, traceEntry & all){
+        traceThread & t = traceLocal();
+        bool busy = t.busy;
+        t.busy = true;
+        std::vector<traceEntry> o, c;
+        traceEntry a;
+        {
+            std::lock_guard<std::mutex> l(lock);
+            for(int f = 0; f < frames; f++)
+                if(ops[f].allocs || ops[f].frees)
+                    o.push_back(entry(names[f], ops[f]));
+            for(int s = 0; s < TRACE_STACKS; s++){
+                const traceStack & k = stacks[s];
+                if(k.depth < 0 || (!k.counts.allocs && !k.counts.frees))
+                    continue;
+                std::string name = k.depth ? "" : "other";
+                for(int d = 0; d < std::min(k.depth, TRACE_DEPTH); d++)
+                    name += (d ? ";" : "") + std::string(names[k.frame[d]]);
+                c.push_back(entry(name, k.counts));
+            }
+            a = entry("total", total);
+        }
+        t.busy = busy;
+        operations.swap(o);
+        calls.swap(c);
+        all = a;
+    }
+
+    // starts the counts again, bytes still live carried over
+    void reset(){
+        std::lock_guard<std::mutex> l(lock);
+        restart(total);
+        for(int f = 0; f < frames; f++)
+            restart(ops[f]);
+        for(int s = 0; s < TRACE_STACKS; s++)
+            restart(stacks[s].counts);
+    }
+
+private:
+    std::mutex lock;
+    const char * names[TRACE_FRAMES] = {};
+    int frames = 0;
+    traceCounts ops[TRACE_FRAMES];
+    traceStack stacks[TRACE_STACKS];
+    traceCounts total;
+
+    // slot of the thread's stack, claimed if new, -1 once the table is full
+    int find(const traceThread & t){
+        int depth = std::min(t.depth, TRACE_DEPTH);
+        uint64_t h = 14695981039346656037ull ^ t.depth;
+        for(int d = 0; d < depth; d++)
+            h = (h ^ t.frame[d]) * 1099511628211ull;
+        for(int i = 0; i < TRACE_STACKS; i++){
+            traceStack & k = stacks[(h + i) % TRACE_STACKS];
+            if(k.depth < 0){
+                k.depth = t.depth;
+                std::copy(t.frame, t.frame + depth, k.frame);
+                return static_cast<int>((h + i) % TRACE_STACKS);
+            }
+            if(k.depth == t.depth && std::equal(t.frame, t.frame + depth, k.frame))
+                return static_cast<int>((h + i) % TRACE_STACKS);
+        }
+        return -1;
+    }
+
+    static traceEntry entry(const std::string & name, const traceCounts & c){
+        return traceEntry {name, c.allocs, c.frees, c.bytes, c.live, c.peak};
+    }
+    static void restart(traceCounts & c){
+        c.allocs = c.frees = c.bytes = 0;
+        c.peak = c.live;
+    }
+};
+
+traceRegistry & tracer(){
+    static traceRegistry r;
+    return r;
+}
+
+// pushes an operation on this thread's stack until the scope ends
+class traceFrame {
+public:
+    traceFrame(int f){
+        traceThread & t = traceLocal();
+        if(t.depth < TRACE_DEPTH)
+            t.frame[t.depth] = f;
+        t.depth++;
+        t.stack = -1;
+    }
+    ~traceFrame(){
+        traceThread & t = traceLocal();
+        t.depth--;
+        t.stack = -1;
+    }
+};
+
+// traced blocks start with the size and the stack they were charged to,
+// placed just below the pointer handed out
+struct traceHeader {
+    uint64_t bytes;
+    int64_t stack;
+};
+
+void * traceAllocate(size_t bytes, size_t align){
+    size_t skip = std::max(align, sizeof(traceHeader));
+    void * base;
+    if(align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+        base = std::malloc(bytes + skip);
+    else
+        base = std::aligned_alloc(align, (bytes + skip + align - 1) / align * align);
+    if(!base)
+        return nullptr;
+    char * p = static_cast<char *>(base) + skip;
+    traceHeader * h = reinterpret_cast<traceHeader *>(p) - 1;
+    h->bytes = bytes;
+    h->stack = tracer().take(bytes);
+    return p;
+}
+void traceRelease(void * p, size_t align){
+    if(!p)
+        return;
+    traceHeader * h = static_cast<traceHeader *>(p) - 1;
+    tracer().give(static_cast<int>(h->stack), h->bytes);
+    std::free(static_cast<char *>(p) - std::max(align, sizeof(traceHeader)));
+}
+void * traceAllocateOrThrow(size_t bytes, size_t align){
+    void * p = traceAllocate(bytes, align);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void * operator new(size_t n){
+    return traceAllocateOrThrow(n, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void * operator new[](size_t n){
+    return traceAllocateOrThrow(n, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void * operator new(size_t n, std::align_val_t a){
+    return traceAllocateOrThrow(n, static_cast<size_t>(a));
+}
+void * operator new[](size_t n, std::align_val_t a){
+    return traceAllocateOrThrow(n, static_cast<size_t>(a));
+}
+void * operator new(size_t n, const std::nothrow_t &) noexcept {
+    return traceAllocate(n, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void * operator new[](size_t n, const std::nothrow_t &) noexcept {
+    return traceAllocate(n, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void * operator new(size_t n, std::align_val_t a, const std::nothrow_t &) noexcept {
+    return traceAllocate(n, static_cast<size_t>(a));
+}
+void * operator new[](size_t n, std::align_val_t a, const std::nothrow_t &) noexcept {
+    return traceAllocate(n, static_cast<size_t>(a));
+}
+void operator delete(void * p) noexcept {
+    traceRelease(p, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void operator delete[](void * p) noexcept {
+    traceRelease(p, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void operator delete(void * p, size_t) noexcept {
+    traceRelease(p, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void operator delete[](void * p, size_t) noexcept {
+    traceRelease(p, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void operator delete(void * p, std::align_val_t a) noexcept {
+    traceRelease(p, static_cast<size_t>(a));
+}
+void operator delete[](void * p, std::align_val_t a) noexcept {
+    traceRelease(p, static_cast<size_t>(a));
+}
+void operator delete(void * p, size_t, std::align_val_t a) noexcept {
+    traceRelease(p, static_cast<size_t>(a));
+}
+void operator delete[](void * p, size_t, std::align_val_t a) noexcept {
+    traceRelease(p, static_cast<size_t>(a));
+}
+void operator delete(void * p, const std::nothrow_t &) noexcept {
+    traceRelease(p, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void operator delete[](void * p, const std::nothrow_t &) noexcept {
+    traceRelease(p, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void operator delete(void * p, std::align_val_t a, const std::nothrow_t &) noexcept {
+    traceRelease(p, static_cast<size_t>(a));
+}
+void operator delete[](void * p, std::align_val_t a, const std::nothrow_t &) noexcept {
+    traceRelease(p, static_cast<size_t>(a));
+}
+
+void traceSnapshot(std::vector<traceEntry> & operations, std::vector<traceEntry> & calls, traceEntry & all){
+    tracer().snapshot(operations, calls, all);
+}
+void traceReset(){
+    tracer().reset();
+}
+
+// one frame per block, the name registered on its first run
+#define TRACE_SCOPE(name) \
+    static const int traceSite = tracer().frame(name); \
+    traceFrame traceProbe(traceSite)
+
+#else
+
+void traceSnapshot(std::vector<traceEntry> & operations, std::vector<traceEntry> & calls, traceEntry & all){
+    operations.clear();
+    calls.clear();
+    all = traceEntry {"total", 0, 0, 0, 0, 0};
+}
+void traceReset(){
+}
+
+#define TRACE_SCOPE(name)
+
+#endif
+
+// summary of the allocations since the last reset, operations and
+// call stacks listed by bytes allocated, at most rows of each
+void traceReport(std::ostream & out, int rows = 20){
+    std::vector<traceEntry> operations, calls;
+    traceEntry all;
+    traceSnapshot(operations, calls, all);
+    auto byBytes = [](const traceEntry & a, const traceEntry & b){
+        return a.bytes > b.bytes;
+    };
+    std::sort(operations.begin(), operations.end(), byBytes);
+    std::sort(calls.begin(), calls.end(), byBytes);
+    out << "allocations " << all.allocs << ", frees " << all.frees << ", bytes " << all.bytes;
+    out << ", live " << all.live << ", peak live " << all.peak << "\n";
+    const char * title[2] = {"by operation", "by call stack"};
+    std::vector<traceEntry> * list[2] = {&operations, &calls};
+    for(int k = 0; k < 2; k++){
+        out << "\n" << title[k] << "\n";
+        out << "      allocs          bytes      peak live  name\n";
+        for(int i = 0; i < std::min(rows, static_cast<int>(list[k]->size())); i++){
+            const traceEntry & e = (*list[k])[i];
+            std::string c = std::to_string(e.allocs), b = std::to_string(e.bytes), p = std::to_string(e.peak);
+            out << std::string(12 - std::min<size_t>(12, c.size()), ' ') << c;
+            out << std::string(15 - std::min<size_t>(15, b.size()), ' ') << b;
+            out << std::string(15 - std::min<size_t>(15, p.size()), ' ') << p;
+            out << "  " << e.name << "\n";
+        }
+    }
+}
+
+// call stacks in the collapsed "a;b;c weight" format of flame graph
+// tools, weighted by bytes allocated or else by allocations
+void traceFlame(std::ostream & out, bool bytes = true){
+    std::vector<traceEntry> operations, calls;
+    traceEntry all;
+    traceSnapshot(operations, calls, all);
+    for(const traceEntry & e : calls)
+        if(bytes ? e.bytes : e.allocs)
+            out << e.name << " " << (bytes ? e.bytes : e.allocs) << "\n";
+}
+
+#endif /* trace_h */
@@ -0,0 +1,146 @@
+//
+//  transform.h
+//  VecLib
+//
+// Batch vertex transformation: large arrays of points, normals and
+// vec4s run through one mat4. The matrix is loaded into locals once and
+// each element goes through the same straight line of multiply adds,
+// with no calls and no branches inside the loop, so the compiler keeps
+// the coefficients in registers and vectorizes across elements. Points
+// take the affine path unless the matrix is a projection, and normals
+// go through the inverse transpose of the 3 x 3 part, found once per
+// batch. Arrays past TRANSFORM_PARALLEL elements are split over the
+// shared thread pool. Input and output may be the same array.
+//
+
+#ifndef transform_h
+#define transform_h
+
+#include <cmath>
+#include "math.h"
+#include "parallel.h"
+
+// elements per thread before a batch is split
+#define TRANSFORM_PARALLEL (1 << 14)
+
+// the 16 entries of m, row by row
+void transformCoefficients(mat4 m, double * a){
+    vec4 r[4] = {m.x, m.y, m.z, m.w};
+    for(int i = 0; i < 4; i++){
+        a[4 * i] = r[i].x;
+        a[4 * i + 1] = r[i].y;
+        a[4 * i + 2] = r[i].z;
+        a[4 * i + 3] = r[i].w;
+    }
+}
+
+// n points of 3 channels each, divided through by w unless affine
+template <typename T>
+void transformPointChannels(const double * a, bool affine, const T * p, T * out, int n){
+    parallelFor(n, TRANSFORM_PARALLEL, [&](int b, int e){
+        const double m00 = a[0], m01 = a[1], m02 = a[2], m03 = a[3];
+        const double m10 = a[4], m11 = a[5], m12 = a[6], m13 = a[7];
+        const double m20 = a[8], m21 = a[9], m22 = a[10], m23 = a[11];
+        const double m30 = a[12], m31 = a[13], m32 = a[14], m33 = a[15];
+        if(affine){
+            for(int i = b; i < e; i++){
+                double x = p[3 * i], y = p[3 * i + 1], z = p[3 * i + 2];
+                out[3 * i] = static_cast<T>(m00 * x + m01 * y + m02 * z + m03);
+                out[3 * i + 1] = static_cast<T>(m10 * x + m11 * y + m12 * z + m13);
+                out[3 * i + 2] = static_cast<T>(m20 * x + m21 * y + m22 * z + m23);
+            }
+            return;
+        }
+        for(int i = b; i < e; i++){
+            double x = p[3 * i], y = p[3 * i + 1], z = p[3 * i + 2];
+            double r = 1 / (m30 * x + m31 * y + m32 * z + m33);
+            out[3 * i] = static_cast<T>((m00 * x + m01 * y + m02 * z + m03) * r);
+            out[3 * i + 1] = static_cast<T>((m10 * x + m11 * y + m12 * z + m13) * r);
+            out[3 * i + 2] = static_cast<T>((m20 * x + m21 * y + m22 * z + m23) * r);
+        }
+    });
+}
+
+// n directions of 3 channels each through the 3 x 3 part of a,
+// rescaled to unit length if normalize
+template <typename T>
+void transformDirectionChannels(const double * a, bool normalize, const T * v, T * out, int n){
+    parallelFor(n, TRANSFORM_PARALLEL, [&](int b, int e){
+        const double m00 = a[0], m01 = a[1], m02 = a[2];
+        const double m10 = a[4], m11 = a[5], m12 = a[6];
+        const double m20 = a[8], m21 = a[9], m22 = a[10];
+        for(int i = b; i < e; i++){
+            double x = v[3 * i], y = v[3 * i + 1], z = v[3 * i + 2];
+            double tx = m00 * x + m01 * y + m02 * z;
+            double ty = m10 * x + m11 * y + m12 * z;
+            double tz = m20 * x + m21 * y + m22 * z;
+            // zero length stays zero
+            double l = tx * tx + ty * ty + tz * tz;
+            double r = normalize && l > 0 ? 1 / std::sqrt(l) : 1.0;
+            out[3 * i] = static_cast<T>(tx * r);
+            out[3 * i + 1] = static_cast<T>(ty * r);
+            out[3 * i + 2] = static_cast<T>(tz * r);
+        }
+    });
+}
+
+// points, as vec3s or as x, y, z floats
+void transformPoints(mat4 m, const vec3 * p, vec3 * out, int n){
+    PROFILE_SCOPE("transformPoints", 18 * static_cast<uint64_t>(n), 0);
+    double a[16];
+    transformCoefficients(m, a);
+    transformPointChannels(a, m.isAffine(), &p[0].x, &out[0].x, n);
+}
+void transformPoints(mat4 m, const float * xyz, float * out, int n){
+    PROFILE_SCOPE("transformPoints", 18 * static_cast<uint64_t>(n), 0);
+    double a[16];
+    transformCoefficients(m, a);
+    transformPointChannels(a, m.isAffine(), xyz, out, n);
+}
+
+// directions, translation left out
+void transformDirections(mat4 m, const vec3 * v, vec3 * out, int n){
+    PROFILE_SCOPE("transformDirections", 15 * static_cast<uint64_t>(n), 0);
+    double a[16];
+    transformCoefficients(m, a);
+    transformDirectionChannels(a, false, &v[0].x, &out[0].x, n);
+}
+
+// normals, through the inverse transpose so they stay perpendicular to
+// surfaces under non uniform scaling, and unit length again if normalize
+void transformNormals(mat4 m, const vec3 * v, vec3 * out, int n, bool normalize = true){
+    PROFILE_SCOPE("transformNormals", 24 * static_cast<uint64_t>(n), 0);
+    double a[16];
+    transformCoefficients(mat4(vec4(m.x.x, m.x.y, m.x.z, 0.0), vec4(m.y.x, m.y.y, m.y.z, 0.0), vec4(m.z.x, m.z.y, m.z.z, 0.0)).inverse().transpose(), a);
+    transformDirectionChannels(a, normalize, &v[0].x, &out[0].x, n);
+}
+void transformNormals(mat4 m, const float * xyz, float * out, int n, bool normalize = true){
+    PROFILE_SCOPE("transformNormals", 24 * static_cast<uint64_t>(n), 0);
+    double a[16];
+    transformCoefficients(mat4(vec4(m.x.x, m.x.y, m.x.z, 0.0), vec4(m.y.x, m.y.y, m.y.z, 0.0), vec4(m.z.x, m.z.y, m.z.z, 0.0)).inverse().transpose(), a);
+    transformDirectionChannels(a, normalize, xyz, out, n);
+}
+
+// homogeneous vectors, m * v for each
+void transform(mat4 m, const vec4 * v, vec4 * out, int n){
+    PROFILE_SCOPE("transform", 28 * static_cast<uint64_t>(n), 0);
+    double a[16];
+    transformCoefficients(m, a);
+    const double * p = &v[0].x;
+    double * o = &out[0].x;
+    parallelFor(n, TRANSFORM_PARALLEL, [&](int b, int e){
+        const double m00 = a[0], m01 = a[1], m02 = a[2], m03 = a[3];
+        const double m10 = a[4], m11 = a[5], m12 = a[6], m13 = a[7];
+        const double m20 = a[8], m21 = a[9], m22 = a[10], m23 = a[11];
+        const double m30 = a[12], m31 = a[13], m32 = a[14], m33 = a[15];
+        for(int i = b; i < e; i++){
+            double x = p[4 * i], y = p[4 * i + 1], z = p[4 * i + 2], w = p[4 * i + 3];
+            o[4 * i] = m00 * x + m01 * y + m02 * z + m03 * w;
+            o[4 * i + 1] = m10 * x + m11 * y + m12 * z + m13 * w;
+            o[4 * i + 2] = m20 * x + m21 * y + m22 * z + m23 * w;
+            o[4 * i + 3] = m30 * x + m31 * y + m32 * z + m33 * w;
+        }
+    });
+}
+
+#endif /* transform_h */